@@ -1,7 +1,16 @@
 #version 120
+#extension GL_ARB_uniform_buffer_object : require
 
-uniform mat4 P;
-uniform mat4 MV;
+// camera and lights, see UniformBlocks.h
+#define NUM_LIGHTS 2
+layout(std140) uniform Frame {
+  mat4 P;
+  mat4 V;
+  vec4 lightsPos[NUM_LIGHTS];
+  vec4 lightsColor[NUM_LIGHTS];
+};
+
+uniform mat4 MV; // view * model, per object
 
 attribute vec4 aPos; // in object space
 attribute vec3 aNor; // in object space
@@ -9,6 +18,7 @@ attribute vec3 aNor; // in object space
 // In camera space
 varying vec3 vPos;
 varying vec3 vNor;
+varying vec4 vColor; // always the material's kd here
 
 void main()
 {
@@ -20,6 +30,7 @@ void main()
   // Transform normal into camera space
   // (Assumes MV does not contain non-uniform scaling)
   vNor = normalize( (MV * vec4(aNor,0.0)).xyz );
+  vColor = vec4(0.0, 0.0, 0.0, 1.0);
 
     
   // Compute the final clip-space position.
@@ -1,11 +1,30 @@
 // bling_phong_frag_mult_lights.glsl
 #version 120
-uniform sampler2D texture0;
+#extension GL_ARB_uniform_buffer_object : require
+
+// camera and lights, see UniformBlocks.h
 #define NUM_LIGHTS 2
-uniform vec3 lightsPos[NUM_LIGHTS];
-uniform vec3 lightsColor[NUM_LIGHTS];
-uniform vec3 ka, kd, ks;
-uniform float s;
+layout(std140) uniform Frame {
+  mat4 P;
+  mat4 V;
+  vec4 lightsPos[NUM_LIGHTS];
+  vec4 lightsColor[NUM_LIGHTS];
+};
+
+// material table, this program's entry is picked by material
+#define MAX_MATERIALS 16
+struct MaterialEntry {
+  vec4 ke;
+  vec4 kd;
+  vec4 ks; // w is the shininess
+};
+layout(std140) uniform Materials {
+  MaterialEntry materials[MAX_MATERIALS];
+};
+uniform int material;
+
+uniform sampler2D texture0;
+uniform vec3 ka;
 
 varying vec3 vPos;
 varying vec3 vNor;
@@ -18,14 +37,18 @@ void main() {
   // sample your brick texture
   vec3 baseColor = texture2D(texture0, uv).rgb;
 
+  vec3 kd = materials[material].kd.xyz;
+  vec3 ks = materials[material].ks.xyz;
+  float s = materials[material].ks.w;
+
   // Blinn‑Phong on top
   vec3 n = normalize(vNor);
   vec3 e = normalize(-vPos);
   vec3 color = ka * baseColor;          // ambient
   for(int i=0;i<NUM_LIGHTS;i++){
-    vec3 L = normalize(lightsPos[i] - vPos);
+    vec3 L = normalize(lightsPos[i].xyz - vPos);
     vec3 h = normalize(L+e);
-    color += lightsColor[i] * (
+    color += lightsColor[i].xyz * (
       kd * max(dot(n,L),0.0) +
       ks * pow(max(dot(n,h),0.0), s)
     ) * baseColor; // modulate by texture
@@ -1,18 +1,36 @@
 #version 120
+#extension GL_ARB_uniform_buffer_object : require
 
+// camera and lights, see UniformBlocks.h
 #define NUM_LIGHTS 2
-uniform vec3 lightsPos[NUM_LIGHTS];
-uniform vec3 lightsColor[NUM_LIGHTS];
+layout(std140) uniform Frame {
+  mat4 P;
+  mat4 V;
+  vec4 lightsPos[NUM_LIGHTS];
+  vec4 lightsColor[NUM_LIGHTS];
+};
 
-uniform vec3 ke;
-uniform vec3 kd;
-uniform vec3 ks;
-uniform float s;
+// material table, this program's entry is picked by material
+#define MAX_MATERIALS 16
+struct MaterialEntry {
+  vec4 ke;
+  vec4 kd;
+  vec4 ks; // w is the shininess
+};
+layout(std140) uniform Materials {
+  MaterialEntry materials[MAX_MATERIALS];
+};
+uniform int material;
 
 varying vec3 vPos;
 varying vec3 vNor;
+varying vec4 vColor; // per instance kd, used where alpha is 0
 void main()
 {
+  vec3 ke = materials[material].ke.xyz;
+  vec3 kd = mix(vColor.rgb, materials[material].kd.xyz, vColor.a);
+  vec3 ks = materials[material].ks.xyz;
+  float s = materials[material].ks.w;
 
   // Norm intrepolated normal
   vec3 n = normalize(vNor);
@@ -24,7 +42,7 @@ void main()
   // Compute Light vectors
   for (int i = 0; i < NUM_LIGHTS; i++) {
 
-    vec3 L = normalize(lightsPos[i] - vPos);
+    vec3 L = normalize(lightsPos[i].xyz - vPos);
 
     // Compute diffusion using Lambert's Law
     vec3 diff = kd * max(0, dot(n, L));
@@ -35,8 +53,8 @@ void main()
     // COmputing the specular component
     vec3 spec = ks * pow(max(dot(n, h), 0), s);
 
-    vec3 color = lightsColor[i] * (diff + spec);
-    float r = length(lightsPos[i] - vPos);
+    vec3 color = lightsColor[i].xyz * (diff + spec);
+    float r = length(lightsPos[i].xyz - vPos);
     // Using 10% strength of light at r = 3,  1% at r = 10 resulting in:
     // A0 = 1.0, A1 = 0.0429, A2 = 0.9857
     float Attenuation = 1.0 / (1.0 + (0.0429 * r) + (0.9857 * r * r));
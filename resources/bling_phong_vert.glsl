@@ -1,14 +1,23 @@
 // bling_phong_vert.glsl
 #version 120
-uniform mat4 P;
-uniform mat4 MV;
+#extension GL_ARB_uniform_buffer_object : require
+
+// camera and lights, see UniformBlocks.h
+#define NUM_LIGHTS 2
+layout(std140) uniform Frame {
+  mat4 P;
+  mat4 V;
+  vec4 lightsPos[NUM_LIGHTS];
+  vec4 lightsColor[NUM_LIGHTS];
+};
 
 // per‑vertex
 attribute vec4 aPos;
 attribute vec3 aNor;
 
-// instancing
-attribute vec4 aInstMat0, aInstMat1, aInstMat2, aInstMat3;
+// instancing: translation + uniform scale, and a unit quaternion
+attribute vec4 aInstPosScale;
+attribute vec4 aInstRot;
 
 // how many repeats per world‑unit
 uniform float tileScale;
@@ -17,16 +26,20 @@ varying vec3 vPos;      // eye‑space position
 varying vec3 vNor;      // eye‑space normal
 varying vec2 vTileUV;   // our “world‑XY” UV
 
+vec3 quatRotate(vec4 q, vec3 v) {
+  return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
 void main() {
-  mat4 M = mat4(aInstMat0, aInstMat1, aInstMat2, aInstMat3);
+  vec4 q = normalize(aInstRot); // snorm16 rounding
 
   // world‑space location of this vertex
-  vec3 worldPos = (M * aPos).xyz;
+  vec3 worldPos = quatRotate(q, aPos.xyz * aInstPosScale.w) + aInstPosScale.xyz;
 
   // classic Blinn‑Phong pass‑through
-  vec4 camPos = MV * M * aPos;
+  vec4 camPos = V * vec4(worldPos, 1.0);
   vPos = camPos.xyz;
-  vNor = (MV * M * vec4(aNor,0.0)).xyz;
+  vNor = (V * vec4(quatRotate(q, aNor), 0.0)).xyz;
 
   // **project onto the XY plane** so we tile bricks across
   // width (X) and height (Y) of the wall
@@ -1,32 +1,41 @@
 #version 120
+#extension GL_ARB_uniform_buffer_object : require
 
-uniform mat4 P;
-uniform mat4 MV;
+// camera and lights, see UniformBlocks.h
+#define NUM_LIGHTS 2
+layout(std140) uniform Frame {
+  mat4 P;
+  mat4 V;
+  vec4 lightsPos[NUM_LIGHTS];
+  vec4 lightsColor[NUM_LIGHTS];
+};
 
 attribute vec4 aPos; // in object space
 attribute vec3 aNor; // in object space
 
 
-attribute vec4 aInstMat0;
-attribute vec4 aInstMat1;
-attribute vec4 aInstMat2;
-attribute vec4 aInstMat3;
+attribute vec4 aInstPosScale; // translation, uniform scale
+attribute vec4 aInstRot;      // unit quaternion
+attribute vec4 aInstColor;    // targets: kd where a is 0, see InstanceData.h
 
 // In camera space
 varying vec3 vPos;
 varying vec3 vNor;
+varying vec4 vColor;
+
+vec3 quatRotate(vec4 q, vec3 v)
+{
+  return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
 
 void main()
 {
-  mat4 M = mat4(
-      aInstMat0,
-      aInstMat1,
-      aInstMat2,
-      aInstMat3
-      );
-
-  vec4 cameraPos = MV * M * aPos;
+  vec4 q = normalize(aInstRot);
+  vec3 worldPos = quatRotate(q, aPos.xyz * aInstPosScale.w) + aInstPosScale.xyz;
+
+  vec4 cameraPos = V * vec4(worldPos, 1.0);
   vPos = cameraPos.xyz;
-  vNor = (MV * M * vec4(aNor, 0.0)).xyz;
+  vNor = (V * vec4(quatRotate(q, aNor), 0.0)).xyz;
+  vColor = aInstColor;
   gl_Position = P * cameraPos;
 }
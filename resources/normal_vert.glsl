@@ -1,6 +1,15 @@
 #version 120
+#extension GL_ARB_uniform_buffer_object : require
+
+// camera and lights, see UniformBlocks.h
+#define NUM_LIGHTS 2
+layout(std140) uniform Frame {
+	mat4 P;
+	mat4 V;
+	vec4 lightsPos[NUM_LIGHTS];
+	vec4 lightsColor[NUM_LIGHTS];
+};
 
-uniform mat4 P;
 uniform mat4 MV;
 
 attribute vec4 aPos; // in object space
@@ -1,10 +1,9 @@
 // text_frag.glsl
 #version 120
 uniform sampler2D text;
-uniform vec3 textColor;
 varying vec2 TexCoords;
+varying vec3 vColor;
 void main() {
     float alpha = texture2D(text, TexCoords).r;
-    gl_FragColor = vec4(textColor, alpha);
+    gl_FragColor = vec4(vColor, alpha);
 }
-
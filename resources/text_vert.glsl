@@ -1,11 +1,13 @@
 // text_vert.glsl
 #version 120
-attribute vec4 aPos;    // <vec2 pos, vec2 uv>
-attribute vec2 aTex;
+attribute vec2 aPos;    // pixels
+attribute vec2 aTex;    // atlas uv
+attribute vec4 aColor;
 uniform mat4 projection;
 varying vec2 TexCoords;
+varying vec3 vColor;
 void main() {
-    gl_Position = projection * vec4(aPos.xy, 0.0, 1.0);
-    TexCoords = aPos.zw;
+    gl_Position = projection * vec4(aPos, 0.0, 1.0);
+    TexCoords = aTex;
+    vColor = aColor.rgb;
 }
-
@@ -0,0 +1,34 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#include <cfloat>
+#include <glm/glm.hpp>
+
+// World space axis aligned box, used by the broadphase
+struct AABB {
+  glm::vec3 min = glm::vec3(FLT_MAX);
+  glm::vec3 max = glm::vec3(-FLT_MAX);
+
+  AABB() = default;
+  AABB(const glm::vec3 &min, const glm::vec3 &max) : min(min), max(max) {};
+
+  bool isEmpty() const { return min.x > max.x; };
+  glm::vec3 center() const { return 0.5f * (min + max); };
+  void expand(const glm::vec3 &p) {
+    min = glm::min(min, p);
+    max = glm::max(max, p);
+  };
+  void expand(const AABB &b) {
+    min = glm::min(min, b.min);
+    max = glm::max(max, b.max);
+  };
+  // Inclusive so touching boxes still reach the narrowphase
+  bool overlaps(const AABB &b) const {
+    return min.x <= b.max.x && max.x >= b.min.x && min.y <= b.max.y &&
+           max.y >= b.min.y && min.z <= b.max.z && max.z >= b.min.z;
+  };
+  bool contains(const glm::vec3 &p) const {
+    return p.x >= min.x && p.x <= max.x && p.y >= min.y && p.y <= max.y &&
+           p.z >= min.z && p.z <= max.z;
+  };
+};
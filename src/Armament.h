@@ -11,13 +11,22 @@ class Armament {
 private:
   int ricochetAmmo;
   int piercingAmmo;
+  int hitScanAmmo;
 
 public:
-  Armament() : ricochetAmmo(5), piercingAmmo(5) {}; // Default constructor
-  Armament(int ricoAmmo, int pierceAmmo)
-      : ricochetAmmo(ricoAmmo), piercingAmmo(pierceAmmo) {};
+  Armament()
+      : ricochetAmmo(5), piercingAmmo(5), hitScanAmmo(5) {}; // Default
+  Armament(int ricoAmmo, int pierceAmmo, int scanAmmo = 5)
+      : ricochetAmmo(ricoAmmo), piercingAmmo(pierceAmmo),
+        hitScanAmmo(scanAmmo) {};
+  // modes: 0 ricochet, 1 piercing, 2 hit-scan
   bool hasAmmo(int mode) {
-    if (mode == 1) {
+    if (mode == 2) {
+      if (this->hitScanAmmo > 0) {
+        return true;
+      }
+      std::cout << "[ARMAMENT] OUT OF HIT-SCAN AMMO" << std::endl;
+    } else if (mode == 1) {
       if (this->piercingAmmo > 0) {
         return true;
       }
@@ -33,7 +42,11 @@ public:
   };
 
   void decrementAmmo(int mode) {
-    if (mode == 1) {
+    if (mode == 2) {
+      if (hitScanAmmo > 0) {
+        this->hitScanAmmo--;
+      }
+    } else if (mode == 1) {
       if (piercingAmmo > 0) {
         this->piercingAmmo--;
       }
@@ -48,9 +61,10 @@ public:
                                             glm::vec3 bulletVVec, int mode) {
     if (hasAmmo(mode)) {
       decrementAmmo(mode);
-      return BulletRequest{bulletPos, bulletVVec,
-                           mode == 1 ? BulletType::PIERCING
-                                     : BulletType::RICOCHET};
+      BulletType type = mode == 2   ? BulletType::HITSCAN
+                        : mode == 1 ? BulletType::PIERCING
+                                    : BulletType::RICOCHET;
+      return BulletRequest{bulletPos, bulletVVec, type};
     }
     return std::nullopt; // no shot fired
   };
@@ -58,4 +72,5 @@ public:
   std::pair<int, int> getAmmoLeft() {
     return {this->piercingAmmo, this->ricochetAmmo};
   };
+  int getHitScanAmmo() const { return this->hitScanAmmo; };
 };
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "Structure.h"
+#include <algorithm>
+#include <vector>
+
+// Bounding volume hierarchy over a small set of world AABBs (one per
+// Structure). Items are plain indices into whatever vector the caller built
+// the tree from, so queries never touch shared_ptrs.
+class Broadphase {
+private:
+  static constexpr int LEAF_SIZE = 2;
+  static constexpr int MAX_DEPTH = 64;
+
+  struct Node {
+    AABB bounds;
+    int left = -1; // children, -1 for leaves
+    int right = -1;
+    int first = 0; // range into order[] for leaves
+    int count = 0;
+  };
+
+  std::vector<Node> nodes;
+  std::vector<int> order; // item indices, grouped by leaf
+  std::vector<AABB> itemBounds;
+  bool dirty = false;
+
+  int buildNode(int first, int count) {
+    int idx = (int)nodes.size();
+    nodes.push_back(Node());
+    AABB box, centers;
+    for (int i = first; i < first + count; ++i) {
+      box.expand(itemBounds[order[i]]);
+      centers.expand(itemBounds[order[i]].center());
+    }
+    nodes[idx].bounds = box;
+
+    if (count <= LEAF_SIZE) {
+      nodes[idx].first = first;
+      nodes[idx].count = count;
+      return idx;
+    }
+
+    // Median split along the widest axis of the item centers
+    glm::vec3 ext = centers.max - centers.min;
+    int axis = 0;
+    if (ext.y > ext[axis])
+      axis = 1;
+    if (ext.z > ext[axis])
+      axis = 2;
+    int mid = first + count / 2;
+    std::nth_element(order.begin() + first, order.begin() + mid,
+                     order.begin() + first + count, [&](int a, int b) {
+                       return itemBounds[a].center()[axis] <
+                              itemBounds[b].center()[axis];
+                     });
+
+    // Children are always pushed after their parent, refit relies on this
+    int left = buildNode(first, mid - first);
+    int right = buildNode(mid, first + count - mid);
+    nodes[idx].left = left;
+    nodes[idx].right = right;
+    return idx;
+  }
+
+public:
+  void build(const std::vector<AABB> &bounds) {
+    itemBounds = bounds;
+    order.resize(bounds.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+      order[i] = (int)i;
+    }
+    nodes.clear();
+    nodes.reserve(2 * bounds.size() + 1);
+    if (!bounds.empty()) {
+      buildNode(0, (int)bounds.size());
+    }
+    dirty = false;
+  };
+
+  void setBounds(int item, const AABB &b) {
+    itemBounds[item] = b;
+    dirty = true;
+  };
+
+  // Keep the topology, just grow/shrink node boxes bottom up
+  void refit() {
+    if (!dirty)
+      return;
+    for (int n = (int)nodes.size() - 1; n >= 0; --n) {
+      Node &node = nodes[n];
+      AABB box;
+      if (node.left < 0) {
+        for (int i = node.first; i < node.first + node.count; ++i) {
+          box.expand(itemBounds[order[i]]);
+        }
+      } else {
+        box.expand(nodes[node.left].bounds);
+        box.expand(nodes[node.right].bounds);
+      }
+      node.bounds = box;
+    }
+    dirty = false;
+  };
+
+  // Calls visit(item) for every item whose bounds overlap box. Returning false
+  // from visit stops the traversal early.
+  template <typename F> void query(const AABB &box, F &&visit) const {
+    if (nodes.empty())
+      return;
+    int stack[MAX_DEPTH];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+      const Node &node = nodes[stack[--top]];
+      if (!node.bounds.overlaps(box))
+        continue;
+      if (node.left < 0) {
+        for (int i = node.first; i < node.first + node.count; ++i) {
+          if (itemBounds[order[i]].overlaps(box) && !visit(order[i]))
+            return;
+        }
+      } else {
+        assert(top + 2 <= MAX_DEPTH);
+        stack[top++] = node.right;
+        stack[top++] = node.left;
+      }
+    }
+  }
+
+  size_t size() const { return this->itemBounds.size(); };
+};
@@ -1,8 +1,14 @@
 #pragma once
 
+#include "Broadphase.h"
+#include "DynamicRing.h"
+#include "Raycast.h"
+#include "VaoCache.h"
 #include "Structure.h"
+#include "Sweep.h"
+#include "TargetSystem.h"
 #include <algorithm>
-enum class BulletType { RICOCHET, PIERCING };
+enum class BulletType { RICOCHET, PIERCING, HITSCAN };
 
 // Thanks alot for ChatGPT for great help in developing collision detection
 struct Bullet {
@@ -16,33 +22,17 @@ struct Bullet {
 class BulletManager {
 private:
   std::shared_ptr<Shape> sphereMesh;
-  std::vector<glm::mat4> modelMatsStatic;
+  std::vector<glm::vec4> instances; // posScale per live bullet
   std::vector<Bullet> bullets;
-
-  GLuint instanceVBO = 0;
+  std::vector<Bullet> shots; // hit-scan rays, resolved on the next update
 
 public:
   BulletManager(std::shared_ptr<Shape> sphereMesh) : sphereMesh(sphereMesh) {
     assert(sphereMesh->getType() == ShapeType::SPHERE);
-
-    // generate one VBO for our instance‐mats
-    glGenBuffers(1, &instanceVBO);
-  };
-  ~BulletManager() {
-    if (instanceVBO)
-      glDeleteBuffers(1, &instanceVBO);
   };
 
   std::vector<Bullet> &getBullets() { return this->bullets; };
 
-  // use when updating bullets
-  void uploadInstanceBuffer() {
-    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
-    glBufferData(GL_ARRAY_BUFFER, modelMatsStatic.size() * sizeof(glm::mat4),
-                 modelMatsStatic.data(), GL_DYNAMIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-  }
-
   // POVPosition to mean spawn bullet in front of player in the direction they
   // are looking
   void spawnBullet(glm::vec3 playerPOVPosition = glm::vec3(0.0f),
@@ -51,187 +41,154 @@ public:
     bullets.push_back({playerPOVPosition, velocity, 4, type, true});
   };
 
-  void update(float dt, std::vector<std::shared_ptr<Structure>> &structures) {
-    modelMatsStatic.clear();
+  // Hit-scan: no projectile, the shot is a single ray cast through the
+  // structures on the next update. velocity gives the direction and the
+  // push the debris gets.
+  void fireRay(glm::vec3 origin, glm::vec3 velocity) {
+    shots.push_back({origin, velocity, 0, BulletType::HITSCAN, true});
+  };
+
+  // Moves every bullet through its whole step with swept tests, so a bullet
+  // can't tunnel through a one cube wall or past a target however long the
+  // frame was. The first contact along the path is resolved at its time of
+  // impact and a ricochet carries on with the time left. Returns how many
+  // targets were hit.
+  int update(float dt, std::vector<std::shared_ptr<Structure>> &structures,
+             const Broadphase &broadphase, TargetSystem &targets) {
+    const float radius = 0.5f; // bullet radius
+    const int MAX_CONTACTS = 4; // per bullet per step, ricochets included
+    int targetsHit = resolveShots(structures, broadphase, targets);
+    instances.clear();
     for (auto it = bullets.begin(); it != bullets.end();) {
-      bool bouncedThisFrame = false;
       if (!it->alive) {
         it = bullets.erase(it);
         continue;
       }
-      // 1) advance
-      it->position += it->velocity * dt;
-
-      // Collison test
-      bool bulletKilled = false;
-      for (auto structure : structures) {
-        float radius = 0.5f; // bullet radius
-        auto hits = structure->collisionSphere(it->position, radius);
-
-        if (!hits.empty()) {
-          // sort descending so highest indices are procesed first
-          // kill bullet if PIERCING and has collided
-          std::sort(hits.begin(), hits.end(), std::greater<int>());
-          if (it->type == BulletType::PIERCING) {
-            if (structure->getFracturable()) {
-              for (int idx : hits) {
-                structure->fracturedCube(idx, it->position, it->velocity);
-              }
-            }
-            // kill the bullet
-            it = bullets.erase(it);
-            // re‐upload your wall's instance buffer so that the fractured cubes
-            // vanish
-            structure->uploadInstanceBuffer();
-            bulletKilled = true;
-            break; // out of the structures loop
-          } else {
-            // RICOCHET: reflect the velocity around the cube normal (optional)
-            for (int k : hits) {
-              // // 1) Grab the model matrix for cube k and compute its inverse
-              // (no scale):
-              glm::mat4 M = structure->getModelMatsStatic()[k];
-              glm::mat4 M_inv = glm::inverse(M);
-
-              // 2) Transform the bullet position into cube‐local coordinates:
-              glm::vec4 localPos4 = M_inv * glm::vec4(it->position, 1.0f);
-              glm::vec3 localPos = glm::vec3(localPos4) - glm::vec3(0.0f);
-              // since cubes are centered at the origin in local space
-
-              // 3) Decide which face you’re closest to:
-              glm::vec3 d = localPos;
-              float ax = fabs(d.x), ay = fabs(d.y), az = fabs(d.z);
-              glm::vec3 localNormal(0.0f);
-              if (ax > ay && ax > az)
-                localNormal.x = (d.x > 0.0f ? 1.0f : -1.0f);
-              else if (ay > ax && ay > az)
-                localNormal.y = (d.y > 0.0f ? 1.0f : -1.0f);
-              else
-                localNormal.z = (d.z > 0.0f ? 1.0f : -1.0f);
-
-              // 4) Rotate that normal back into world‐space (ignore
-              // translation):
-              glm::vec3 worldNormal = glm::mat3(M) * localNormal;
-              worldNormal = glm::normalize(worldNormal);
-              // wrote — reflect velocity:
-              glm::vec3 V = it->velocity;
-              glm::vec3 R = V - 2.0f * glm::dot(V, worldNormal) * worldNormal;
-              it->velocity = R * 0.8f;
-
-              // nudge out:
-              it->position += worldNormal * 0.01f;
-
-              // decrement bounce count & kill if exhausted:
-              it->remainingBounces--;
-              if (it->remainingBounces <= 0) {
-                it->alive = false;
-              }
-              bouncedThisFrame = true;
-              break; // only handle the first hit this frame
+
+      float left = dt; // time still to move this step
+      for (int contact = 0; contact < MAX_CONTACTS && it->alive; ++contact) {
+        glm::vec3 from = it->position;
+        glm::vec3 to = from + it->velocity * left;
+
+        // Earliest cube over every structure the path's box touches
+        SweepHit hit;
+        std::shared_ptr<Structure> hitStructure;
+        AABB path = sweptBounds(from, to, radius);
+        broadphase.query(path, [&](int s) {
+          if (structures[s]->sweepSphere(from, to, radius, hit))
+            hitStructure = structures[s];
+          return true;
+        });
+
+        // A target in front of the wall takes the bullet
+        float targetT = hit.t;
+        int target = targets.sweepSphere(from, to, radius, targetT);
+        if (target >= 0) {
+          targets.kill(target);
+          targetsHit++;
+          it->alive = false;
+          break;
+        }
+
+        if (!hitStructure) {
+          it->position = to;
+          break;
+        }
+        it->position = hit.point;
+        left *= 1.0f - hit.t;
+
+        if (it->type == BulletType::PIERCING) {
+          // fracture what the bullet touches at the contact. Handles stay
+          // valid while other cubes are removed, so any order works
+          if (hitStructure->getFracturable()) {
+            CubeHits hits;
+            hitStructure->collisionSphere(hit.point, radius * 1.05f, hits);
+            hitStructure->fracturedCube(hit.cube, hit.point, it->velocity);
+            for (CubeHandle h : hits) {
+              hitStructure->fracturedCube(h, hit.point, it->velocity);
             }
           }
+          it->alive = false;
+          break;
         }
-      }
 
-      if (bulletKilled) {
-        continue;
+        // RICOCHET: reflect off the contact normal the sweep found, the face
+        // normal on a face and rounded off on edges and corners. It always
+        // opposes the velocity, so the bullet leaves the cube.
+        glm::vec3 V = it->velocity;
+        glm::vec3 n = hit.normal;
+        it->velocity = (V - 2.0f * glm::dot(V, n) * n) * 0.8f;
+        it->position += n * 0.01f; // nudge out
+
+        // decrement bounce count & kill if exhausted
+        it->remainingBounces--;
+        if (it->remainingBounces <= 0)
+          it->alive = false;
       }
 
-      if (bouncedThisFrame) {
-        if (it->alive) {
-          // push transform into modelMatsStatic …
-          glm::mat4 M =
-              glm::translate(glm::mat4(1.0f), glm::vec3(it->position));
-          M = M * glm::scale(glm::mat4(1.0f), glm::vec3(0.5f)); // half‑size
-          modelMatsStatic.push_back(M);
-          ++it;
-        }
+      if (!it->alive) {
+        it = bullets.erase(it);
         continue;
       }
 
-      // 3) lifetime / bounds check
+      // lifetime / bounds check
       if (glm::length(it->position) > 100.0f /* or time‑to‑live */) {
         it = bullets.erase(it);
         continue;
-      } else {
-        // still alive
-        glm::mat4 M = glm::translate(glm::mat4(1.0f), glm::vec3(it->position));
-        M = M * glm::scale(glm::mat4(1.0f), glm::vec3(0.5f)); // half‑size
-        modelMatsStatic.push_back(M);
-        ++it;
       }
+      instances.push_back(glm::vec4(it->position, 0.5f)); // half‑size
+      ++it;
     }
-
-    uploadInstanceBuffer();
+    return targetsHit;
   }
 
-  void renderBullets(std::shared_ptr<Program> prog) {
-    if (modelMatsStatic.empty()) {
-      return;
+  // One ray per hit-scan shot, as far as a bullet could live. The first
+  // target in front of the first cube dies, otherwise the cube breaks.
+  int resolveShots(std::vector<std::shared_ptr<Structure>> &structures,
+                   const Broadphase &broadphase, TargetSystem &targets) {
+    const float RANGE = 100.0f;
+    int targetsHit = 0;
+    for (const Bullet &shot : shots) {
+      glm::vec3 dir = glm::normalize(shot.velocity);
+      RayHit hit;
+      int s = raycastWorld(structures, broadphase, shot.position, dir, RANGE,
+                           hit);
+      float dist = s >= 0 ? hit.t : RANGE;
+      int target = targets.raycast(shot.position, dir, dist);
+      if (target >= 0) {
+        targets.kill(target);
+        targetsHit++;
+      } else if (s >= 0 && structures[s]->getFracturable()) {
+        structures[s]->fracturedCube(hit.cube, shot.position + dir * hit.t,
+                                     shot.velocity);
+      }
     }
+    shots.clear();
+    return targetsHit;
+  }
 
-    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
-    glBufferSubData(GL_ARRAY_BUFFER, 0,
-                    modelMatsStatic.size() * sizeof(glm::mat4),
-                    modelMatsStatic.data());
-
-    glBindVertexArray(sphereMesh->getVAO());
-
-    // Bind vetex attribs (aPos and aNor)
-    // aPos
-    int posLoc = prog->getAttribute("aPos");
-    glEnableVertexAttribArray(posLoc);
-    glBindBuffer(GL_ARRAY_BUFFER, sphereMesh->getPosBufID());
-    glVertexAttribPointer(posLoc, 3, GL_FLOAT, GL_FALSE, 0, (void *)0);
-    // aNor
-    int norLoc = prog->getAttribute("aNor");
-    if (norLoc != -1) {
-      glEnableVertexAttribArray(norLoc);
-      glBindBuffer(GL_ARRAY_BUFFER, sphereMesh->getNorBufID());
-      glVertexAttribPointer(norLoc, 3, GL_FLOAT, GL_FALSE, 0, (void *)0);
+  void renderBullets(std::shared_ptr<Program> prog, const Frustum &frustum) {
+    // bullets are drawn at half size, so r = 0.5 covers the sphere. Only the
+    // visible ones are written, straight into the dynamic ring.
+    DynamicRing::Alloc ring =
+        dynamicRing.alloc(instances.size() * sizeof(glm::vec4));
+    if (!ring) {
+      return;
     }
-
-    glBufferSubData(GL_ARRAY_BUFFER, 0,
-                    modelMatsStatic.size() * sizeof(glm::mat4),
-                    modelMatsStatic.data());
-
-    // Tell OpenGL how to interpret that buffer as 4 vec4 attributes:
-    //    suppose you reserve locations 4,5,6,7 for your mat4
-    std::size_t vec4Size = sizeof(glm::vec4);
-    int matLoc[4];
-    matLoc[0] = prog->getAttribute("aInstMat0");
-    matLoc[1] = prog->getAttribute("aInstMat1");
-    matLoc[2] = prog->getAttribute("aInstMat2");
-    matLoc[3] = prog->getAttribute("aInstMat3");
-    for (int i = 0; i < 4; ++i) {
-      if (matLoc[i] < 0)
-        continue; // attribute wasn’t actually active
-      glEnableVertexAttribArray(matLoc[i]);
-      glVertexAttribPointer(matLoc[i], // use the real location
-                            4, GL_FLOAT, GL_FALSE,
-                            sizeof(glm::mat4),     // 64-byte stride
-                            (void *)(i * vec4Size) // offset 0,16,32,48 bytes
-      );
-      glVertexAttribDivisor(matLoc[i], 1);
+    size_t visible = frustum.compactVisible(
+        instances.data(), instances.size(), 0.5f, (glm::vec4 *)ring.ptr);
+    countInstances(visible, instances.size());
+    if (visible == 0) {
+      return;
     }
 
-    // Finally draw instanced
-    GLsizei instanceCount = (GLsizei)modelMatsStatic.size();
-    glDrawArraysInstanced(GL_TRIANGLES, 0, sphereMesh->getVertexCount(),
-                          instanceCount);
+    dynamicRing.commit(ring, visible * sizeof(glm::vec4));
 
-    // Cleanup
-    for (int i = 0; i < 4; ++i) {
-      if (matLoc[i] >= 0) {
-        glDisableVertexAttribArray(matLoc[i]);
-      }
-    }
-    glDisableVertexAttribArray(posLoc);
-    if (norLoc >= 0) {
-      glDisableVertexAttribArray(norLoc);
-    }
-    // cleanup
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    // one posScale vec4 per bullet, spheres don't need a rotation
+    const VaoCache::Entry &vao =
+        vaoCache.get(VertexSource::of(*sphereMesh), *prog,
+                     dynamicRing.getBuffer(), InstanceFormat::POS_SCALE);
+    VaoCache::drawInstanced(vao, sphereMesh->getDrawCount(), (GLsizei)visible,
+                            (GLuint)(ring.offset / sizeof(glm::vec4)));
   }
 };
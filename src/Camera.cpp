@@ -56,7 +56,11 @@ void Camera::mouseMoved(float x, float y) {
 
 void Camera::applyProjectionMatrix(std::shared_ptr<MatrixStack> P) const {
   // Modify provided MatrixStack
-  P->multMatrix(glm::perspective(fovy, aspect, znear, zfar));
+  P->multMatrix(getProjectionMatrix());
+}
+
+glm::mat4 Camera::getProjectionMatrix() const {
+  return glm::perspective(fovy, aspect, znear, zfar);
 }
 
 void Camera::applyViewMatrix(std::shared_ptr<MatrixStack> MV) const {
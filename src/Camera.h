@@ -23,6 +23,7 @@ public:
   void mouseClicked(float x, float y, bool shift, bool ctrl, bool alt);
   void mouseMoved(float x, float y);
   void applyProjectionMatrix(std::shared_ptr<MatrixStack> P) const;
+  glm::mat4 getProjectionMatrix() const;
   // Edited
   void applyViewMatrix(std::shared_ptr<MatrixStack> MV) const;
   void applyViewMatrixFreeLook(std::shared_ptr<MatrixStack> MV) const;
@@ -34,6 +35,7 @@ public:
   glm::vec3 getPosition() { return this->position; };
   void setPosition(glm::vec3 &pos) { this->position = pos; };
   glm::vec3 getForward() { return this->forward; };
+  float getFar() const { return this->zfar; };
   void setPreviousMouse(const glm::vec2 &p) { mousePrev = p; }
   void processMouseMovement(float dx, float dy);
 
@@ -0,0 +1,187 @@
+#include "CubeKernels.h"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) ||            \
+    defined(__SSE2__)
+#define CUBE_SSE 1
+#include <emmintrin.h>
+// GCC and Clang can build AVX functions without -mavx for the whole file,
+// the CPU check below makes sure they only run where they can
+#if defined(__GNUC__)
+#define CUBE_AVX 1
+#include <immintrin.h>
+#define AVX_TARGET __attribute__((target("avx")))
+#endif
+#endif
+
+namespace CubeKernels {
+
+namespace {
+
+// Cubes [first, count) one at a time, also the tail of the vector loops
+void boxMaskScalar(const float *x, const float *y, const float *z,
+                   size_t first, size_t count, const glm::vec3 &lo,
+                   const glm::vec3 &hi, uint64_t *mask) {
+  for (size_t i = first; i < count; ++i) {
+    bool in = x[i] >= lo.x && x[i] <= hi.x && y[i] >= lo.y && y[i] <= hi.y &&
+              z[i] >= lo.z && z[i] <= hi.z;
+    mask[i >> 6] |= (uint64_t)in << (i & 63);
+  }
+}
+
+void sphereMaskScalar(const float *x, const float *y, const float *z,
+                      size_t first, size_t count, const glm::vec3 &p,
+                      float radius, uint64_t *mask) {
+  float r2 = radius * radius;
+  for (size_t i = first; i < count; ++i) {
+    float dx = x[i] - p.x, dy = y[i] - p.y, dz = z[i] - p.z;
+    bool in = dx * dx + dy * dy + dz * dz <= r2;
+    mask[i >> 6] |= (uint64_t)in << (i & 63);
+  }
+}
+
+#if !defined(CUBE_SSE)
+void boxMaskPlain(const float *x, const float *y, const float *z,
+                  size_t count, const glm::vec3 &lo, const glm::vec3 &hi,
+                  uint64_t *mask) {
+  boxMaskScalar(x, y, z, 0, count, lo, hi, mask);
+}
+
+void sphereMaskPlain(const float *x, const float *y, const float *z,
+                     size_t count, const glm::vec3 &p, float radius,
+                     uint64_t *mask) {
+  sphereMaskScalar(x, y, z, 0, count, p, radius, mask);
+}
+#endif
+
+#if defined(CUBE_SSE)
+void boxMaskSSE(const float *x, const float *y, const float *z, size_t count,
+                const glm::vec3 &lo, const glm::vec3 &hi, uint64_t *mask) {
+  __m128 lx = _mm_set1_ps(lo.x), ly = _mm_set1_ps(lo.y),
+         lz = _mm_set1_ps(lo.z);
+  __m128 hx = _mm_set1_ps(hi.x), hy = _mm_set1_ps(hi.y),
+         hz = _mm_set1_ps(hi.z);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128 vx = _mm_loadu_ps(x + i);
+    __m128 vy = _mm_loadu_ps(y + i);
+    __m128 vz = _mm_loadu_ps(z + i);
+    __m128 in = _mm_and_ps(_mm_cmpge_ps(vx, lx), _mm_cmple_ps(vx, hx));
+    in = _mm_and_ps(in, _mm_and_ps(_mm_cmpge_ps(vy, ly), _mm_cmple_ps(vy, hy)));
+    in = _mm_and_ps(in, _mm_and_ps(_mm_cmpge_ps(vz, lz), _mm_cmple_ps(vz, hz)));
+    mask[i >> 6] |= (uint64_t)_mm_movemask_ps(in) << (i & 63);
+  }
+  boxMaskScalar(x, y, z, i, count, lo, hi, mask);
+}
+
+void sphereMaskSSE(const float *x, const float *y, const float *z,
+                   size_t count, const glm::vec3 &p, float radius,
+                   uint64_t *mask) {
+  __m128 px = _mm_set1_ps(p.x), py = _mm_set1_ps(p.y), pz = _mm_set1_ps(p.z);
+  __m128 r2 = _mm_set1_ps(radius * radius);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128 dx = _mm_sub_ps(_mm_loadu_ps(x + i), px);
+    __m128 dy = _mm_sub_ps(_mm_loadu_ps(y + i), py);
+    __m128 dz = _mm_sub_ps(_mm_loadu_ps(z + i), pz);
+    __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+                           _mm_mul_ps(dz, dz));
+    mask[i >> 6] |= (uint64_t)_mm_movemask_ps(_mm_cmple_ps(d2, r2))
+                    << (i & 63);
+  }
+  sphereMaskScalar(x, y, z, i, count, p, radius, mask);
+}
+#endif
+
+#if defined(CUBE_AVX)
+AVX_TARGET void boxMaskAVX(const float *x, const float *y, const float *z,
+                           size_t count, const glm::vec3 &lo,
+                           const glm::vec3 &hi, uint64_t *mask) {
+  __m256 lx = _mm256_set1_ps(lo.x), ly = _mm256_set1_ps(lo.y),
+         lz = _mm256_set1_ps(lo.z);
+  __m256 hx = _mm256_set1_ps(hi.x), hy = _mm256_set1_ps(hi.y),
+         hz = _mm256_set1_ps(hi.z);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256 vx = _mm256_loadu_ps(x + i);
+    __m256 vy = _mm256_loadu_ps(y + i);
+    __m256 vz = _mm256_loadu_ps(z + i);
+    __m256 in = _mm256_and_ps(_mm256_cmp_ps(vx, lx, _CMP_GE_OQ),
+                              _mm256_cmp_ps(vx, hx, _CMP_LE_OQ));
+    in = _mm256_and_ps(in, _mm256_and_ps(_mm256_cmp_ps(vy, ly, _CMP_GE_OQ),
+                                         _mm256_cmp_ps(vy, hy, _CMP_LE_OQ)));
+    in = _mm256_and_ps(in, _mm256_and_ps(_mm256_cmp_ps(vz, lz, _CMP_GE_OQ),
+                                         _mm256_cmp_ps(vz, hz, _CMP_LE_OQ)));
+    mask[i >> 6] |= (uint64_t)_mm256_movemask_ps(in) << (i & 63);
+  }
+  boxMaskScalar(x, y, z, i, count, lo, hi, mask);
+}
+
+AVX_TARGET void sphereMaskAVX(const float *x, const float *y, const float *z,
+                              size_t count, const glm::vec3 &p, float radius,
+                              uint64_t *mask) {
+  __m256 px = _mm256_set1_ps(p.x), py = _mm256_set1_ps(p.y),
+         pz = _mm256_set1_ps(p.z);
+  __m256 r2 = _mm256_set1_ps(radius * radius);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + i), px);
+    __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + i), py);
+    __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(z + i), pz);
+    __m256 d2 = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+        _mm256_mul_ps(dz, dz));
+    mask[i >> 6] |=
+        (uint64_t)_mm256_movemask_ps(_mm256_cmp_ps(d2, r2, _CMP_LE_OQ))
+        << (i & 63);
+  }
+  sphereMaskScalar(x, y, z, i, count, p, radius, mask);
+}
+#endif
+
+typedef void (*BoxFn)(const float *, const float *, const float *, size_t,
+                      const glm::vec3 &, const glm::vec3 &, uint64_t *);
+typedef void (*SphereFn)(const float *, const float *, const float *, size_t,
+                         const glm::vec3 &, float, uint64_t *);
+
+struct Kernels {
+  BoxFn box;
+  SphereFn sphere;
+  const char *name;
+};
+
+Kernels pick() {
+#if defined(CUBE_AVX)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx"))
+    return {boxMaskAVX, sphereMaskAVX, "avx"};
+#endif
+#if defined(CUBE_SSE)
+  return {boxMaskSSE, sphereMaskSSE, "sse2"}; // baseline on x86-64
+#else
+  return {boxMaskPlain, sphereMaskPlain, "scalar"};
+#endif
+}
+
+const Kernels &kernels() {
+  static const Kernels k = pick();
+  return k;
+}
+
+} // namespace
+
+void boxMask(const float *x, const float *y, const float *z, size_t count,
+             const glm::vec3 &lo, const glm::vec3 &hi, uint64_t *mask) {
+  memset(mask, 0, maskWords(count) * sizeof(uint64_t));
+  kernels().box(x, y, z, count, lo, hi, mask);
+}
+
+void sphereMask(const float *x, const float *y, const float *z, size_t count,
+                const glm::vec3 &p, float radius, uint64_t *mask) {
+  memset(mask, 0, maskWords(count) * sizeof(uint64_t));
+  kernels().sphere(x, y, z, count, p, radius, mask);
+}
+
+const char *isa() { return kernels().name; }
+
+} // namespace CubeKernels
@@ -0,0 +1,43 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Batched tests over cube centers kept as separate x, y, z float arrays.
+// Each one writes a bit per cube into mask (cube i is bit i % 64 of
+// mask[i / 64]), so mask needs maskWords(count) words. The SSE and AVX
+// versions test 4 or 8 centers at a time and the one to use is picked once
+// from the CPU at run time, with a plain scalar loop for anything else.
+namespace CubeKernels {
+
+inline size_t maskWords(size_t count) { return (count + 63) / 64; }
+
+// Index of the lowest set bit, bits must not be 0
+inline int lowestBit(uint64_t bits) {
+#if defined(_MSC_VER)
+  unsigned long i;
+  _BitScanForward64(&i, bits);
+  return (int)i;
+#else
+  return __builtin_ctzll(bits);
+#endif
+}
+
+// Centers inside [lo, hi], bounds included
+void boxMask(const float *x, const float *y, const float *z, size_t count,
+             const glm::vec3 &lo, const glm::vec3 &hi, uint64_t *mask);
+
+// Centers within radius of p, boundary included
+void sphereMask(const float *x, const float *y, const float *z, size_t count,
+                const glm::vec3 &p, float radius, uint64_t *mask);
+
+// Which version runs: "avx", "sse2" or "scalar"
+const char *isa();
+
+} // namespace CubeKernels
@@ -0,0 +1,265 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+#if defined(__AVX__)
+#define DEBRIS_AVX 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#define DEBRIS_SSE 1
+#include <emmintrin.h>
+#endif
+
+class DebrisField;
+
+// Limits on live (simulated) debris, set before the level is built. When a
+// limit is hit the oldest cube goes first. Resting debris leaves the
+// simulation and is baked into the RubbleBuffer, which has its own cap.
+struct DebrisBudget {
+  size_t perStructureCap = 256;
+  size_t globalCap = 2048;
+  size_t rubbleCap = 4096;
+
+  size_t active = 0;   // live debris over every field
+  uint32_t serial = 0; // spawn counter, lower is older
+  std::vector<DebrisField *> fields;
+};
+
+inline DebrisBudget debrisBudget;
+
+// Fractured cubes flying around, kept as float structure-of-arrays so the
+// integrator runs 4 (SSE) or 8 (AVX) cubes per step. Lanes are padded up to
+// a multiple of LANES with dead entries, so the vector loop never needs a
+// scalar tail (the scalar loop is the fallback for non x86 builds).
+class DebrisField {
+public:
+  static constexpr float GRAVITY = -30.8f;
+  static constexpr float DRAG = 0.9f;
+  static constexpr float BOUNCE = -0.4f; // vy scale on ground contact
+  static constexpr size_t LANES = 8;
+  // Resting = touching the ground with less than this much speed
+  static constexpr float SLEEP_SPEED = 0.5f;
+  static constexpr float SLEEP_BOUNCE = 1.0f; // ground jitter on vy
+
+private:
+  std::vector<float> px, py, pz;
+  std::vector<float> vx, vy, vz;
+  std::vector<float> size;
+  std::vector<uint32_t> serial; // spawn order, for oldest-first eviction
+  size_t count = 0;
+
+  void reserveLanes(size_t n) {
+    size_t padded = (n + LANES - 1) / LANES * LANES;
+    if (padded <= px.size())
+      return;
+    padded = std::max(padded, px.size() * 2);
+    for (auto *a : {&px, &py, &pz, &vx, &vy, &vz, &size}) {
+      a->resize(padded, 0.0f);
+    }
+    serial.resize(padded, 0);
+  }
+
+  // Swap-remove, order of the survivors doesn't matter
+  void removeAt(size_t i) {
+    size_t last = count - 1;
+    px[i] = px[last];
+    py[i] = py[last];
+    pz[i] = pz[last];
+    vx[i] = vx[last];
+    vy[i] = vy[last];
+    vz[i] = vz[last];
+    size[i] = size[last];
+    serial[i] = serial[last];
+    count--;
+    debrisBudget.active--;
+  }
+
+  size_t oldest() const {
+    size_t o = 0;
+    for (size_t i = 1; i < count; ++i) {
+      if (serial[i] < serial[o])
+        o = i;
+    }
+    return o;
+  }
+
+  // Drop the oldest live cube over all fields
+  static void evictGlobalOldest() {
+    DebrisField *victim = nullptr;
+    size_t victimIdx = 0;
+    for (auto *f : debrisBudget.fields) {
+      if (f->count == 0)
+        continue;
+      size_t o = f->oldest();
+      if (!victim || f->serial[o] < victim->serial[victimIdx]) {
+        victim = f;
+        victimIdx = o;
+      }
+    }
+    if (victim)
+      victim->removeAt(victimIdx);
+  }
+
+  void integrateScalar(size_t first, float dt) {
+    float damp = 1.0f - DRAG * dt;
+    for (size_t i = first; i < count; ++i) {
+      float nvx = vx[i] * damp;
+      float nvy = (vy[i] + GRAVITY * dt) * damp;
+      float nvz = vz[i] * damp;
+      float npy = py[i] + nvy * dt;
+      px[i] += nvx * dt;
+      pz[i] += nvz * dt;
+      // simple ground bounce
+      if (npy < 0.0f) {
+        npy = 0.0f;
+        nvy *= BOUNCE;
+      }
+      py[i] = npy;
+      vx[i] = nvx;
+      vy[i] = nvy;
+      vz[i] = nvz;
+    }
+  }
+
+public:
+  DebrisField() { debrisBudget.fields.push_back(this); };
+  ~DebrisField() {
+    auto &fields = debrisBudget.fields;
+    fields.erase(std::remove(fields.begin(), fields.end(), this), fields.end());
+    debrisBudget.active -= count;
+  };
+  // registered by address in debrisBudget
+  DebrisField(const DebrisField &) = delete;
+  DebrisField &operator=(const DebrisField &) = delete;
+
+  size_t getCount() const { return this->count; };
+  bool empty() const { return count == 0; };
+
+  void spawn(const glm::vec3 &pos, const glm::vec3 &vel, float s) {
+    if (debrisBudget.perStructureCap == 0 || debrisBudget.globalCap == 0)
+      return;
+    if (count >= debrisBudget.perStructureCap)
+      removeAt(oldest());
+    if (debrisBudget.active >= debrisBudget.globalCap)
+      evictGlobalOldest();
+    reserveLanes(count + 1);
+    px[count] = pos.x;
+    py[count] = pos.y;
+    pz[count] = pos.z;
+    vx[count] = vel.x;
+    vy[count] = vel.y;
+    vz[count] = vel.z;
+    size[count] = s;
+    serial[count] = debrisBudget.serial++;
+    count++;
+    debrisBudget.active++;
+  };
+
+  // Takes every cube that has come to rest out of the simulation, handing
+  // its position and size to bake first
+  template <typename F> void collectSleepers(F &&bake) {
+    for (size_t i = 0; i < count;) {
+      bool grounded = py[i] <= 0.0f;
+      bool slow = vx[i] * vx[i] + vz[i] * vz[i] < SLEEP_SPEED * SLEEP_SPEED &&
+                  fabs(vy[i]) < SLEEP_BOUNCE;
+      if (grounded && slow) {
+        bake(getPosition(i), size[i]);
+        removeAt(i);
+      } else {
+        ++i;
+      }
+    }
+  }
+
+  glm::vec3 getPosition(size_t i) const {
+    return glm::vec3(px[i], py[i], pz[i]);
+  };
+  glm::vec3 getVelocity(size_t i) const {
+    return glm::vec3(vx[i], vy[i], vz[i]);
+  };
+
+  // Applies the affine transform R to every position and direction
+  void transform(const glm::mat4 &R) {
+    for (size_t i = 0; i < count; ++i) {
+      glm::vec3 p = glm::vec3(R * glm::vec4(px[i], py[i], pz[i], 1.0f));
+      glm::vec3 v = glm::vec3(R * glm::vec4(vx[i], vy[i], vz[i], 0.0f));
+      px[i] = p.x;
+      py[i] = p.y;
+      pz[i] = p.z;
+      vx[i] = v.x;
+      vy[i] = v.y;
+      vz[i] = v.z;
+    }
+  };
+
+  // gravity + air drag, then a ground bounce at y = 0
+  void integrate(float dt) {
+    size_t i = 0;
+#if defined(DEBRIS_AVX)
+    __m256 g = _mm256_set1_ps(GRAVITY * dt);
+    __m256 damp = _mm256_set1_ps(1.0f - DRAG * dt);
+    __m256 vdt = _mm256_set1_ps(dt);
+    __m256 bounce = _mm256_set1_ps(BOUNCE);
+    __m256 zero = _mm256_setzero_ps();
+    for (; i < count; i += 8) {
+      __m256 nvx = _mm256_mul_ps(_mm256_loadu_ps(&vx[i]), damp);
+      __m256 nvy =
+          _mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(&vy[i]), g), damp);
+      __m256 nvz = _mm256_mul_ps(_mm256_loadu_ps(&vz[i]), damp);
+      __m256 npy = _mm256_add_ps(_mm256_loadu_ps(&py[i]),
+                                 _mm256_mul_ps(nvy, vdt));
+      _mm256_storeu_ps(&px[i], _mm256_add_ps(_mm256_loadu_ps(&px[i]),
+                                             _mm256_mul_ps(nvx, vdt)));
+      _mm256_storeu_ps(&pz[i], _mm256_add_ps(_mm256_loadu_ps(&pz[i]),
+                                             _mm256_mul_ps(nvz, vdt)));
+      __m256 below = _mm256_cmp_ps(npy, zero, _CMP_LT_OQ);
+      npy = _mm256_blendv_ps(npy, zero, below);
+      nvy = _mm256_blendv_ps(nvy, _mm256_mul_ps(nvy, bounce), below);
+      _mm256_storeu_ps(&py[i], npy);
+      _mm256_storeu_ps(&vx[i], nvx);
+      _mm256_storeu_ps(&vy[i], nvy);
+      _mm256_storeu_ps(&vz[i], nvz);
+    }
+#elif defined(DEBRIS_SSE)
+    __m128 g = _mm_set1_ps(GRAVITY * dt);
+    __m128 damp = _mm_set1_ps(1.0f - DRAG * dt);
+    __m128 vdt = _mm_set1_ps(dt);
+    __m128 bounce = _mm_set1_ps(BOUNCE);
+    __m128 zero = _mm_setzero_ps();
+    for (; i < count; i += 4) {
+      __m128 nvx = _mm_mul_ps(_mm_loadu_ps(&vx[i]), damp);
+      __m128 nvy = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(&vy[i]), g), damp);
+      __m128 nvz = _mm_mul_ps(_mm_loadu_ps(&vz[i]), damp);
+      __m128 npy = _mm_add_ps(_mm_loadu_ps(&py[i]), _mm_mul_ps(nvy, vdt));
+      _mm_storeu_ps(&px[i],
+                    _mm_add_ps(_mm_loadu_ps(&px[i]), _mm_mul_ps(nvx, vdt)));
+      _mm_storeu_ps(&pz[i],
+                    _mm_add_ps(_mm_loadu_ps(&pz[i]), _mm_mul_ps(nvz, vdt)));
+      __m128 below = _mm_cmplt_ps(npy, zero);
+      npy = _mm_andnot_ps(below, npy); // 0 where below
+      nvy = _mm_or_ps(_mm_andnot_ps(below, nvy),
+                      _mm_and_ps(below, _mm_mul_ps(nvy, bounce)));
+      _mm_storeu_ps(&py[i], npy);
+      _mm_storeu_ps(&vx[i], nvx);
+      _mm_storeu_ps(&vy[i], nvy);
+      _mm_storeu_ps(&vz[i], nvz);
+    }
+#endif
+    if (i < count)
+      integrateScalar(i, dt);
+  };
+
+  // Instance posScale (xyz position, w size) straight from the arrays, out
+  // needs room for getCount() of them
+  void writeInstances(glm::vec4 *out) const {
+    for (size_t i = 0; i < count; ++i) {
+      out[i] = glm::vec4(px[i], py[i], pz[i], size[i]);
+    }
+  };
+};
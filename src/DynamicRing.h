@@ -0,0 +1,153 @@
+#pragma once
+
+#include "FrameStats.h"
+#include <GL/glew.h>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+// Per frame vertex/instance data (debris, bullets, text) goes through one
+// GL_ARRAY_BUFFER split into FRAMES regions. Each frame writes into its own
+// region while the GPU may still be reading the previous ones; a fence per
+// region makes sure we never write over data still in flight. With
+// ARB_buffer_storage the buffer is persistently mapped and callers write
+// straight into it. Without it writes go to a staging copy and are sent with
+// one glBufferSubData per allocation, into a region the fence says is idle.
+class DynamicRing {
+public:
+  static constexpr int FRAMES = 3;
+
+  // Where an allocation lives: write to ptr, draw from offset in getBuffer()
+  struct Alloc {
+    void *ptr = nullptr;
+    size_t offset = 0;
+    explicit operator bool() const { return ptr != nullptr; };
+  };
+
+private:
+  GLuint buffer = 0;
+  size_t regionSize = 0;
+  int frame = 0;
+  size_t head = 0; // bytes used in the current region
+  char *mapped = nullptr;
+  bool persistent = false;
+  std::vector<char> staging; // fallback, one region
+  GLsync fences[FRAMES] = {};
+
+public:
+  DynamicRing() = default;
+  DynamicRing(const DynamicRing &) = delete;
+  DynamicRing &operator=(const DynamicRing &) = delete;
+
+  void init(size_t bytesPerFrame) {
+    release();
+    regionSize = bytesPerFrame;
+    persistent = GLEW_ARB_buffer_storage;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    size_t total = regionSize * FRAMES;
+    if (persistent) {
+      GLbitfield flags =
+          GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+      glBufferStorage(GL_ARRAY_BUFFER, total, nullptr, flags);
+      mapped = (char *)glMapBufferRange(GL_ARRAY_BUFFER, 0, total, flags);
+      persistent = mapped != nullptr;
+      if (!persistent) {
+        // storage is immutable, start over with a plain buffer
+        glDeleteBuffers(1, &buffer);
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+      }
+    }
+    if (!persistent) {
+      glBufferData(GL_ARRAY_BUFFER, total, nullptr, GL_STREAM_DRAW);
+      staging.resize(regionSize);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    frame = 0;
+    head = 0;
+  };
+
+  // Frees the buffer and fences. The ring is a global that outlives the GL
+  // context, so main calls this before the window goes; nothing is freed on
+  // destruction.
+  void release() {
+    for (auto &f : fences) {
+      if (f)
+        glDeleteSync(f);
+      f = nullptr;
+    }
+    if (buffer) {
+      if (mapped) {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+      }
+      glDeleteBuffers(1, &buffer);
+    }
+    buffer = 0;
+    mapped = nullptr;
+  };
+
+  // Start writing into the next region, waiting for the GPU only if it is
+  // still reading what we put there FRAMES frames ago
+  void beginFrame() {
+    frame = (frame + 1) % FRAMES;
+    head = 0;
+    GLsync &f = fences[frame];
+    if (f) {
+      GLenum r = glClientWaitSync(f, 0, 0);
+      while (r == GL_TIMEOUT_EXPIRED) {
+        r = glClientWaitSync(f, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+      }
+      glDeleteSync(f);
+      f = nullptr;
+    }
+  };
+
+  // Call after the last draw reading this frame's region
+  void endFrame() {
+    fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  };
+
+  // bytes of room in this frame's region, a failed Alloc when it is full.
+  // The offset is aligned in the whole buffer, so with align = record size
+  // offset / align is a record index even for sizes like 20.
+  Alloc alloc(size_t bytes, size_t align = 16) {
+    Alloc a;
+    size_t base = (size_t)frame * regionSize;
+    size_t start = (base + head + align - 1) / align * align - base;
+    if (bytes == 0 || start + bytes > regionSize)
+      return a;
+    head = start + bytes;
+    a.offset = base + start;
+    a.ptr = persistent ? mapped + a.offset : staging.data() + start;
+    return a;
+  };
+
+  // Done writing the first used bytes of a, they can be drawn from after
+  // this. Binds the ring to GL_ARRAY_BUFFER so the caller can point
+  // attributes at a.offset.
+  void commit(const Alloc &a, size_t used) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    if (!persistent && used > 0) {
+      glBufferSubData(GL_ARRAY_BUFFER, a.offset, used, a.ptr);
+    }
+    countUpload(used);
+  };
+
+  // alloc + copy + commit
+  Alloc upload(const void *data, size_t bytes) {
+    Alloc a = alloc(bytes);
+    if (a) {
+      memcpy(a.ptr, data, bytes);
+      commit(a, bytes);
+    }
+    return a;
+  };
+
+  GLuint getBuffer() const { return this->buffer; };
+  bool isPersistent() const { return this->persistent; };
+};
+
+inline DynamicRing dynamicRing;
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+
+// Counters that systems bump while a frame runs
+struct FrameCounters {
+  size_t bytesUploaded = 0; // instance data sent to the GPU
+  // frustum culling, see Frustum.h
+  int structuresVisible = 0;
+  int structuresCulled = 0;
+  size_t instancesVisible = 0;
+  size_t instancesCulled = 0;
+  // state changes that reached GL, see GLState.h and RenderQueue.h
+  int programBinds = 0;
+  int vaoBinds = 0;
+  int textureBinds = 0;
+  int drawPackets = 0;
+};
+
+// Per-frame numbers for the debug HUD (toggle with 'i'). render() rolls
+// current into last once the frame is done, the HUD shows last.
+struct FrameStats {
+  FrameCounters current;
+  FrameCounters last;
+
+  void endFrame() {
+    last = current;
+    current = FrameCounters();
+  };
+};
+
+inline FrameStats frameStats;
+
+inline void countUpload(size_t bytes) {
+  frameStats.current.bytesUploaded += bytes;
+}
+
+inline void countInstances(size_t visible, size_t total) {
+  frameStats.current.instancesVisible += visible;
+  frameStats.current.instancesCulled += total - visible;
+}
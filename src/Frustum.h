@@ -0,0 +1,95 @@
+#pragma once
+
+#include "AABB.h"
+#include <cmath>
+#include <cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define FRUSTUM_SSE 1
+#include <emmintrin.h>
+#endif
+
+// View frustum as six inward facing planes (xyz = unit normal, w = offset),
+// a point p is inside a plane when dot(xyz, p) + w >= 0
+struct Frustum {
+  glm::vec4 planes[6];
+
+  Frustum() = default;
+  explicit Frustum(const glm::mat4 &PV) { extract(PV); };
+
+  // Gribb/Hartmann: planes straight from the rows of P * V. glm is column
+  // major so row r is (m[0][r], m[1][r], m[2][r], m[3][r]).
+  void extract(const glm::mat4 &m) {
+    glm::vec4 row[4];
+    for (int r = 0; r < 4; ++r) {
+      row[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+    }
+    planes[0] = row[3] + row[0]; // left
+    planes[1] = row[3] - row[0]; // right
+    planes[2] = row[3] + row[1]; // bottom
+    planes[3] = row[3] - row[1]; // top
+    planes[4] = row[3] + row[2]; // near
+    planes[5] = row[3] - row[2]; // far
+    for (auto &p : planes) {
+      p /= glm::length(glm::vec3(p));
+    }
+  };
+
+  bool intersects(const AABB &b) const {
+    if (b.isEmpty())
+      return false;
+    glm::vec3 c = b.center();
+    glm::vec3 e = b.max - c;
+    for (const auto &p : planes) {
+      glm::vec3 n(p);
+      float r = e.x * fabs(n.x) + e.y * fabs(n.y) + e.z * fabs(n.z);
+      if (glm::dot(n, c) + p.w + r < 0.0f)
+        return false;
+    }
+    return true;
+  };
+
+  bool intersectsSphere(const glm::vec3 &c, float radius) const {
+    for (const auto &p : planes) {
+      if (glm::dot(glm::vec3(p), c) + p.w < -radius)
+        return false;
+    }
+    return true;
+  };
+
+  // Compacts the instances (posScale, see InstanceData.h) whose centre with a
+  // bounding radius touches the frustum into out, keeping their order. out
+  // may alias in. Returns how many were kept.
+  size_t compactVisible(const glm::vec4 *in, size_t count, float radius,
+                        glm::vec4 *out) const {
+    size_t kept = 0;
+    size_t i = 0;
+#ifdef FRUSTUM_SSE
+    // four instance centres per step, one plane at a time
+    __m128 negR = _mm_set1_ps(-radius);
+    for (; i + 4 <= count; i += 4) {
+      __m128 x = _mm_setr_ps(in[i].x, in[i + 1].x, in[i + 2].x, in[i + 3].x);
+      __m128 y = _mm_setr_ps(in[i].y, in[i + 1].y, in[i + 2].y, in[i + 3].y);
+      __m128 z = _mm_setr_ps(in[i].z, in[i + 1].z, in[i + 2].z, in[i + 3].z);
+      __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+      for (const auto &p : planes) {
+        __m128 d = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(p.x)),
+                       _mm_mul_ps(y, _mm_set1_ps(p.y))),
+            _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(p.z)), _mm_set1_ps(p.w)));
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(d, negR));
+      }
+      int mask = _mm_movemask_ps(inside);
+      for (int j = 0; j < 4; ++j) {
+        if (mask & (1 << j))
+          out[kept++] = in[i + j];
+      }
+    }
+#endif
+    for (; i < count; ++i) {
+      if (intersectsSphere(glm::vec3(in[i]), radius))
+        out[kept++] = in[i];
+    }
+    return kept;
+  };
+};
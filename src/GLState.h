@@ -0,0 +1,58 @@
+#pragma once
+
+#include "FrameStats.h"
+#include <GL/glew.h>
+
+// Shadow copy of the GL binds we switch all the time (program, VAO, 2D
+// texture per unit). Binding what is already bound is skipped, and the binds
+// that do reach GL are counted for the HUD. This only works if every bind of
+// these goes through here, so nobody calls glUseProgram, glBindVertexArray,
+// glActiveTexture or glBindTexture(GL_TEXTURE_2D) directly.
+struct GLState {
+  static constexpr int UNITS = 8;
+
+  GLuint program = 0;
+  GLuint vao = 0;
+  int unit = 0;
+  GLuint textures[UNITS] = {};
+
+  void useProgram(GLuint p) {
+    if (p == program)
+      return;
+    glUseProgram(p);
+    program = p;
+    frameStats.current.programBinds++;
+  };
+
+  void bindVertexArray(GLuint v) {
+    if (v == vao)
+      return;
+    glBindVertexArray(v);
+    vao = v;
+    frameStats.current.vaoBinds++;
+  };
+
+  void activeTexture(int u) {
+    if (u == unit)
+      return;
+    glActiveTexture(GL_TEXTURE0 + u);
+    unit = u;
+  };
+
+  void bindTexture(int u, GLuint tex) {
+    if (textures[u] == tex)
+      return;
+    activeTexture(u);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    textures[u] = tex;
+    frameStats.current.textureBinds++;
+  };
+
+  // Deleting the bound VAO reverts the bind to 0 in GL, follow along
+  void deletedVertexArray(GLuint v) {
+    if (v == vao)
+      vao = 0;
+  };
+};
+
+inline GLState glState;
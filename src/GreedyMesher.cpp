@@ -0,0 +1,91 @@
+#include "GreedyMesher.h"
+#include <cstdint>
+
+using glm::ivec3, glm::vec3;
+
+// Two triangles for the quad at corner p spanning du, dv, wound so they face
+// along n
+static void emitQuad(const vec3 &p, const vec3 &du, const vec3 &dv,
+                     const vec3 &n, bool flip, std::vector<MeshVertex> &out) {
+  vec3 c[4] = {p, p + du, p + du + dv, p + dv};
+  static const int front[6] = {0, 1, 2, 0, 2, 3};
+  static const int back[6] = {0, 2, 1, 0, 3, 2};
+  const int *order = flip ? back : front;
+  for (int i = 0; i < 6; ++i) {
+    out.push_back({c[order[i]], n});
+  }
+}
+
+void greedyMeshRegion(const Lattice &lattice, const ivec3 &lo, const ivec3 &hi,
+                      std::vector<MeshVertex> &out) {
+  ivec3 size = hi - lo;
+  std::vector<uint8_t> mask;
+
+  for (int d = 0; d < 3; ++d) {
+    // u, v span the slice; cross(u, v) points along +d
+    int u = (d + 1) % 3;
+    int v = (d + 2) % 3;
+    int su = size[u];
+    int sv = size[v];
+    mask.assign(su * sv, 0);
+
+    for (int side = -1; side <= 1; side += 2) {
+      ivec3 step(0);
+      step[d] = side;
+      vec3 normal(0.0f);
+      normal[d] = (float)side;
+
+      for (int s = lo[d]; s < hi[d]; ++s) {
+        // faces of this slice that point at an empty cell
+        for (int b = 0; b < sv; ++b) {
+          for (int a = 0; a < su; ++a) {
+            ivec3 c;
+            c[d] = s;
+            c[u] = lo[u] + a;
+            c[v] = lo[v] + b;
+            mask[b * su + a] =
+                lattice.occupiedAt(c) && !lattice.occupiedAt(c + step);
+          }
+        }
+
+        // grow each face into the widest, then tallest, rectangle
+        for (int b = 0; b < sv; ++b) {
+          for (int a = 0; a < su;) {
+            if (!mask[b * su + a]) {
+              ++a;
+              continue;
+            }
+            int w = 1;
+            while (a + w < su && mask[b * su + a + w]) {
+              ++w;
+            }
+            int h = 1;
+            for (; b + h < sv; ++h) {
+              bool full = true;
+              for (int x = 0; x < w && full; ++x) {
+                full = mask[(b + h) * su + a + x];
+              }
+              if (!full)
+                break;
+            }
+            for (int y = 0; y < h; ++y) {
+              for (int x = 0; x < w; ++x) {
+                mask[(b + y) * su + a + x] = 0;
+              }
+            }
+
+            vec3 p;
+            p[d] = s + 0.5f * side;
+            p[u] = lo[u] + a - 0.5f;
+            p[v] = lo[v] + b - 0.5f;
+            vec3 du(0.0f), dv(0.0f);
+            du[u] = (float)w;
+            dv[v] = (float)h;
+            emitQuad(p, du, dv, normal, side < 0, out);
+            a += w;
+          }
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "Lattice.h"
+#include <vector>
+
+// Vertex of a meshed structure, in lattice space (cell units, cell (i, j, k)
+// centered on (i, j, k)). The lattice transform is applied in the shader.
+struct MeshVertex {
+  glm::vec3 pos;
+  glm::vec3 nor;
+};
+
+// Appends the exposed faces of the occupied cells in [lo, hi) as greedy
+// merged quads, two triangles each. Faces against occupied cells outside the
+// region are skipped too, so regions can be meshed independently.
+void greedyMeshRegion(const Lattice &lattice, const glm::ivec3 &lo,
+                      const glm::ivec3 &hi, std::vector<MeshVertex> &out);
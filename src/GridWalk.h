@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cfloat>
+#include <cmath>
+#include <glm/glm.hpp>
+
+// 3D DDA (Amanatides & Woo) over unit cells, cell c spans [c, c + 1) in
+// grid coordinates. Follows o + d * t from the cell it starts in, one cell
+// face at a time, so the cost is the number of cells crossed.
+struct GridWalk {
+  glm::ivec3 cell;
+  glm::ivec3 step;
+  glm::vec3 tNext;  // t at the next face crossing on each axis
+  glm::vec3 tDelta; // t between face crossings on each axis
+  int axis = -1;    // axis of the last step, -1 before the first
+
+  GridWalk(const glm::vec3 &o, const glm::vec3 &d, const glm::ivec3 &start)
+      : cell(start) {
+    for (int i = 0; i < 3; ++i) {
+      step[i] = d[i] > 0.0f ? 1 : -1;
+      if (std::fabs(d[i]) < 1e-12f) {
+        tNext[i] = tDelta[i] = FLT_MAX;
+      } else {
+        float face = (float)(d[i] > 0.0f ? cell[i] + 1 : cell[i]);
+        tNext[i] = (face - o[i]) / d[i];
+        tDelta[i] = 1.0f / std::fabs(d[i]);
+      }
+    }
+  }
+
+  // Moves into the next cell, returns the t it is entered at
+  float next() {
+    axis = 0;
+    if (tNext.y < tNext[axis])
+      axis = 1;
+    if (tNext.z < tNext[axis])
+      axis = 2;
+    float t = tNext[axis];
+    cell[axis] += step[axis];
+    tNext[axis] += tDelta[axis];
+    return t;
+  }
+};
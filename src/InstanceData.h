@@ -0,0 +1,145 @@
+#pragma once
+
+#include "Program.h"
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// Per instance data of the cube/sphere shaders. Every instance transform in
+// the game is translate * rotate * uniform scale, so instead of a 64 byte
+// mat4 we send the translation and scale as one vec4 and the rotation as a
+// snorm16 quaternion, and the vertex shader rebuilds the transform.
+// Unrotated instances (debris, rubble, bullets) only send the vec4.
+struct InstanceData {
+  glm::vec4 posScale; // xyz translation, w uniform scale
+  int16_t rot[4];     // unit quaternion (x, y, z, w)
+};
+static_assert(sizeof(InstanceData) == 24, "InstanceData must stay packed");
+
+// Per instance data of the targets: unrotated like debris, plus a colour.
+// The shader takes the colour as kd where alpha is 0 and the material's kd
+// where it is 1, so draws without the array (constant 0, 0, 0, 1) keep their
+// material.
+struct TargetInstance {
+  glm::vec4 posScale;
+  uint8_t color[4]; // rgba8
+};
+static_assert(sizeof(TargetInstance) == 20, "TargetInstance must stay packed");
+
+inline int16_t packSnorm16(float v) {
+  v = std::fmax(-1.0f, std::fmin(1.0f, v));
+  return (int16_t)std::lround(v * 32767.0f);
+}
+
+// Unit quaternion (x, y, z, w) of a pure rotation matrix
+inline glm::vec4 quatFromRotation(const glm::mat3 &R) {
+  // glm is column major, R[c][r] is row r of column c
+  float t = R[0][0] + R[1][1] + R[2][2];
+  glm::vec4 q;
+  if (t > 0.0f) {
+    float s = std::sqrt(t + 1.0f) * 2.0f; // 4w
+    q = glm::vec4((R[1][2] - R[2][1]) / s, (R[2][0] - R[0][2]) / s,
+                  (R[0][1] - R[1][0]) / s, 0.25f * s);
+  } else if (R[0][0] > R[1][1] && R[0][0] > R[2][2]) {
+    float s = std::sqrt(1.0f + R[0][0] - R[1][1] - R[2][2]) * 2.0f; // 4x
+    q = glm::vec4(0.25f * s, (R[1][0] + R[0][1]) / s, (R[2][0] + R[0][2]) / s,
+                  (R[1][2] - R[2][1]) / s);
+  } else if (R[1][1] > R[2][2]) {
+    float s = std::sqrt(1.0f + R[1][1] - R[0][0] - R[2][2]) * 2.0f; // 4y
+    q = glm::vec4((R[1][0] + R[0][1]) / s, 0.25f * s, (R[2][1] + R[1][2]) / s,
+                  (R[2][0] - R[0][2]) / s);
+  } else {
+    float s = std::sqrt(1.0f + R[2][2] - R[0][0] - R[1][1]) * 2.0f; // 4z
+    q = glm::vec4((R[2][0] + R[0][2]) / s, (R[2][1] + R[1][2]) / s, 0.25f * s,
+                  (R[0][1] - R[1][0]) / s);
+  }
+  return q / glm::length(q);
+}
+
+// M must be translate * rotate * uniform scale
+inline InstanceData packInstance(const glm::mat4 &M) {
+  InstanceData d;
+  float s = glm::length(glm::vec3(M[0]));
+  d.posScale = glm::vec4(glm::vec3(M[3]), s);
+  glm::vec4 q = quatFromRotation(glm::mat3(M) / s);
+  for (int i = 0; i < 4; ++i) {
+    d.rot[i] = packSnorm16(q[i]);
+  }
+  return d;
+}
+
+// aInstPosScale/aInstRot of one program, pointed at whatever buffer is bound
+// to GL_ARRAY_BUFFER. With their arrays off both attributes read their
+// constant value, (0, 0, 0, 1) unless someone set it: the identity transform,
+// so non instanced draws need nothing. See VaoCache.h for who calls these.
+struct InstanceAttribs {
+  GLint posScale = -1;
+  GLint rot = -1;
+  GLint color = -1;
+
+  InstanceAttribs() = default;
+  explicit InstanceAttribs(const Program &prog)
+      : posScale(prog.getAttribute("aInstPosScale")),
+        rot(prog.getAttribute("aInstRot")),
+        color(prog.getAttribute("aInstColor")) {};
+
+  // InstanceData records starting at byte offset
+  void bind(size_t offset) const {
+    if (posScale >= 0) {
+      glEnableVertexAttribArray(posScale);
+      glVertexAttribPointer(posScale, 4, GL_FLOAT, GL_FALSE,
+                            sizeof(InstanceData),
+                            (void *)(offset + offsetof(InstanceData, posScale)));
+      glVertexAttribDivisor(posScale, 1);
+    }
+    if (rot >= 0) {
+      glEnableVertexAttribArray(rot);
+      glVertexAttribPointer(rot, 4, GL_SHORT, GL_TRUE, sizeof(InstanceData),
+                            (void *)(offset + offsetof(InstanceData, rot)));
+      glVertexAttribDivisor(rot, 1);
+    }
+  };
+
+  // Tightly packed posScale vec4s, rotation stays the (constant) identity
+  void bindPosScale(size_t offset) const {
+    if (posScale >= 0) {
+      glEnableVertexAttribArray(posScale);
+      glVertexAttribPointer(posScale, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4),
+                            (void *)offset);
+      glVertexAttribDivisor(posScale, 1);
+    }
+  };
+
+  // TargetInstance records starting at byte offset
+  void bindTargets(size_t offset) const {
+    if (posScale >= 0) {
+      glEnableVertexAttribArray(posScale);
+      glVertexAttribPointer(
+          posScale, 4, GL_FLOAT, GL_FALSE, sizeof(TargetInstance),
+          (void *)(offset + offsetof(TargetInstance, posScale)));
+      glVertexAttribDivisor(posScale, 1);
+    }
+    if (color >= 0) {
+      glEnableVertexAttribArray(color);
+      glVertexAttribPointer(color, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+                            sizeof(TargetInstance),
+                            (void *)(offset + offsetof(TargetInstance, color)));
+      glVertexAttribDivisor(color, 1);
+    }
+  };
+
+  // One transform for a whole non instanced draw
+  void setConstant(const glm::vec4 &ps, const glm::vec4 &q) const {
+    if (posScale >= 0)
+      glVertexAttrib4f(posScale, ps.x, ps.y, ps.z, ps.w);
+    if (rot >= 0)
+      glVertexAttrib4f(rot, q.x, q.y, q.z, q.w);
+  };
+
+  // Constants back to the identity
+  void resetConstant() const {
+    setConstant(glm::vec4(0.0f, 0.0f, 0.0f, 1.0f),
+                glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+  };
+};
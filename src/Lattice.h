@@ -0,0 +1,41 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Regular grid the cubes were laid out on. Cell (i, j, k) has its center at
+// origin + rotation * (i, j, k); cubes are unit sized and share the rotation.
+struct Lattice {
+  glm::vec3 origin = glm::vec3(0.0f);
+  glm::mat3 rotation = glm::mat3(1.0f);
+  glm::ivec3 dims = glm::ivec3(0);
+  std::vector<uint64_t> occupancy; // one bit per cell
+  std::vector<int> cellCube;       // cell -> cube slot, -1 if empty
+
+  bool valid() const { return dims.x > 0 && dims.y > 0 && dims.z > 0; };
+  int cellIndex(int i, int j, int k) const {
+    return (k * dims.y + j) * dims.x + i;
+  };
+  bool occupied(int cell) const {
+    return (occupancy[cell >> 6] >> (cell & 63)) & 1ull;
+  };
+  // Bounds checked, anything outside the grid counts as empty
+  bool occupiedAt(const glm::ivec3 &c) const {
+    if (c.x < 0 || c.y < 0 || c.z < 0 || c.x >= dims.x || c.y >= dims.y ||
+        c.z >= dims.z)
+      return false;
+    return occupied(cellIndex(c.x, c.y, c.z));
+  };
+  glm::ivec3 cellCoords(int cell) const {
+    return glm::ivec3(cell % dims.x, (cell / dims.x) % dims.y,
+                      cell / (dims.x * dims.y));
+  };
+  void setOccupied(int cell, bool on) {
+    if (on)
+      occupancy[cell >> 6] |= 1ull << (cell & 63);
+    else
+      occupancy[cell >> 6] &= ~(1ull << (cell & 63));
+  };
+};
@@ -1,3 +1,4 @@
+#pragma once
 #include <cassert>
 #include <cstring>
 #define _USE_MATH_DEFINES
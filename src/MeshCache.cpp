@@ -0,0 +1,181 @@
+#include "MeshCache.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+  if (addr)
+    munmap(addr, length);
+#endif
+}
+
+shared_ptr<MappedFile> MappedFile::open(const string &path) {
+  auto file = make_shared<MappedFile>();
+#ifndef _WIN32
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return nullptr;
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    void *p = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                   fd, 0);
+    if (p != MAP_FAILED) {
+      file->addr = (char *)p;
+      file->length = st.st_size;
+    }
+  }
+  close(fd);
+  if (file->addr)
+    return file;
+#endif
+  // no mmap, read it in
+  FILE *fp = fopen(path.c_str(), "rb");
+  if (!fp)
+    return nullptr;
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  if (size > 0) {
+    file->copy.resize(size);
+    file->copy.resize(fread(file->copy.data(), 1, size, fp));
+  }
+  fclose(fp);
+  file->length = file->copy.size();
+  return file->length > 0 ? file : nullptr;
+}
+
+namespace MeshCache {
+
+static string cacheDir;
+
+void setDir(const string &dir) {
+  cacheDir = dir;
+  if (!dir.empty()) {
+    error_code ec;
+    filesystem::create_directories(dir, ec);
+  }
+}
+
+const string &getDir() { return cacheDir; }
+
+string pathFor(const string &source) {
+  if (cacheDir.empty())
+    return "";
+  // the name of the OBJ plus a hash of its full path, two resource dirs with
+  // the same mesh names don't collide
+  uint64_t h = 14695981039346656037ull;
+  for (unsigned char c : source) {
+    h ^= c;
+    h *= 1099511628211ull;
+  }
+  char suffix[24];
+  snprintf(suffix, sizeof(suffix), "-%08x.mesh", (unsigned)(h ^ (h >> 32)));
+  return cacheDir + "/" + filesystem::path(source).stem().string() + suffix;
+}
+
+static bool sourceStamp(const string &source, uint64_t &size, int64_t &time) {
+  struct stat st;
+  if (stat(source.c_str(), &st) != 0)
+    return false;
+  size = st.st_size;
+  time = st.st_mtime;
+  return true;
+}
+
+bool load(const string &source, shared_ptr<MappedFile> &file,
+          MeshArrays &out) {
+  string path = pathFor(source);
+  if (path.empty())
+    return false;
+  shared_ptr<MappedFile> f = MappedFile::open(path);
+  if (!f || f->size() < sizeof(MeshFileHeader))
+    return false;
+
+  MeshFileHeader hdr;
+  memcpy(&hdr, f->data(), sizeof(hdr));
+  if (memcmp(hdr.magic, "TPMS", 4) != 0 || hdr.version != MESH_FILE_VERSION)
+    return false;
+  uint64_t size;
+  int64_t time;
+  if (sourceStamp(source, size, time) &&
+      (size != hdr.sourceSize || time != hdr.sourceTime))
+    return false; // OBJ changed since
+  size_t n = hdr.vertexCount;
+  size_t floats =
+      n * (3 + (hdr.hasNormals ? 3 : 0) + (hdr.hasTexcoords ? 2 : 0));
+  size_t expected = sizeof(hdr) + floats * sizeof(float) +
+                    (size_t)hdr.indexCount * sizeof(uint32_t);
+  if (f->size() != expected)
+    return false;
+
+  char *p = f->data() + sizeof(hdr);
+  out = MeshArrays();
+  out.pos = Span<float>((float *)p, 3 * n);
+  p += 3 * n * sizeof(float);
+  if (hdr.hasNormals) {
+    out.nor = Span<float>((float *)p, 3 * n);
+    p += 3 * n * sizeof(float);
+  }
+  if (hdr.hasTexcoords) {
+    out.tex = Span<float>((float *)p, 2 * n);
+    p += 2 * n * sizeof(float);
+  }
+  out.indices = Span<uint32_t>((uint32_t *)p, hdr.indexCount);
+  const float *lo = hdr.boundsMin, *hi = hdr.boundsMax;
+  out.boundsMin = glm::vec3(lo[0], lo[1], lo[2]);
+  out.boundsMax = glm::vec3(hi[0], hi[1], hi[2]);
+  file = f;
+  return true;
+}
+
+bool save(const string &source, const MeshArrays &arrays) {
+  string path = pathFor(source);
+  if (path.empty() || arrays.pos.empty())
+    return false;
+
+  MeshFileHeader hdr = {};
+  memcpy(hdr.magic, "TPMS", 4);
+  hdr.version = MESH_FILE_VERSION;
+  sourceStamp(source, hdr.sourceSize, hdr.sourceTime);
+  hdr.vertexCount = (uint32_t)(arrays.pos.size() / 3);
+  hdr.indexCount = (uint32_t)arrays.indices.size();
+  hdr.hasNormals = !arrays.nor.empty();
+  hdr.hasTexcoords = !arrays.tex.empty();
+  for (int k = 0; k < 3; ++k) {
+    hdr.boundsMin[k] = arrays.boundsMin[k];
+    hdr.boundsMax[k] = arrays.boundsMax[k];
+  }
+
+  // written next to it and renamed, a crash never leaves half a mesh
+  string tmp = path + ".tmp";
+  FILE *fp = fopen(tmp.c_str(), "wb");
+  if (!fp)
+    return false;
+  bool ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1;
+  auto put = [&](const void *data, size_t bytes) {
+    if (bytes > 0)
+      ok = ok && fwrite(data, 1, bytes, fp) == bytes;
+  };
+  put(arrays.pos.data(), arrays.pos.size() * sizeof(float));
+  put(arrays.nor.data(), arrays.nor.size() * sizeof(float));
+  put(arrays.tex.data(), arrays.tex.size() * sizeof(float));
+  put(arrays.indices.data(), arrays.indices.size() * sizeof(uint32_t));
+  ok = fclose(fp) == 0 && ok;
+  if (!ok) {
+    remove(tmp.c_str());
+    return false;
+  }
+  return rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+} // namespace MeshCache
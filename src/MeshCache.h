@@ -0,0 +1,81 @@
+#pragma once
+
+#include "Span.h"
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A whole file in memory. mmap()ed where we can (private and writable, so
+// writes are copy on write and never reach the file), read in otherwise.
+class MappedFile {
+private:
+  char *addr = nullptr;
+  size_t length = 0;
+  std::vector<char> copy; // when not mapped
+
+public:
+  MappedFile() = default;
+  ~MappedFile();
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  // nullptr if the file can't be opened or is empty
+  static std::shared_ptr<MappedFile> open(const std::string &path);
+
+  char *data() { return addr ? addr : copy.data(); };
+  size_t size() const { return this->length; };
+};
+
+// Compiled mesh: a header, then the welded and cache ordered arrays Shape
+// draws from,
+//   float pos[3 * vertexCount]
+//   float nor[3 * vertexCount]   if hasNormals
+//   float tex[2 * vertexCount]   if hasTexcoords
+//   uint32_t indices[indexCount]
+// The source OBJ's size and mtime are in the header, a cache whose source
+// changed is rebuilt.
+struct MeshFileHeader {
+  char magic[4]; // "TPMS"
+  uint32_t version;
+  uint64_t sourceSize;
+  int64_t sourceTime;
+  uint32_t vertexCount;
+  uint32_t indexCount; // 0 for a plain triangle list
+  uint32_t hasNormals;
+  uint32_t hasTexcoords;
+  float boundsMin[3];
+  float boundsMax[3];
+};
+static_assert(sizeof(MeshFileHeader) == 64, "MeshFileHeader must stay packed");
+
+// 2: vertices welded and indexed
+constexpr uint32_t MESH_FILE_VERSION = 2;
+
+// Views into a mesh file (or anything else that outlives them)
+struct MeshArrays {
+  Span<float> pos, nor, tex;
+  Span<uint32_t> indices;
+  glm::vec3 boundsMin = glm::vec3(0.0f), boundsMax = glm::vec3(0.0f);
+};
+
+namespace MeshCache {
+
+// Directory for compiled meshes, empty turns the cache off
+void setDir(const std::string &dir);
+const std::string &getDir();
+
+// Cache file for an OBJ, empty when the cache is off
+std::string pathFor(const std::string &source);
+
+// Maps the cache of source if there is an up to date one. The arrays point
+// into file, which must be kept alive as long as they are used.
+bool load(const std::string &source, std::shared_ptr<MappedFile> &file,
+          MeshArrays &out);
+
+// Writes arrays, bounds included, as the cache of source
+bool save(const std::string &source, const MeshArrays &arrays);
+
+} // namespace MeshCache
@@ -0,0 +1,173 @@
+#include "MeshOptimizer.h"
+#include <cstring>
+#include <unordered_map>
+
+using namespace std;
+
+namespace MeshOptimizer {
+
+namespace {
+
+// One corner's attributes as raw bits, so -0.0 and 0.0 (or NaNs) never weld
+struct CornerKey {
+  uint32_t bits[8];
+  bool operator==(const CornerKey &o) const {
+    return memcmp(bits, o.bits, sizeof(bits)) == 0;
+  };
+};
+
+struct CornerHash {
+  size_t operator()(const CornerKey &k) const {
+    uint64_t h = 14695981039346656037ull;
+    for (uint32_t b : k.bits) {
+      h ^= b;
+      h *= 1099511628211ull;
+    }
+    return (size_t)h;
+  };
+};
+
+// Moves vertex attributes to their new slots, remap[old] = new
+void remapVertices(vector<float> &buf, int width, const vector<uint32_t> &remap,
+                   size_t newCount) {
+  if (buf.empty())
+    return;
+  vector<float> out(newCount * width);
+  for (size_t v = 0; v < remap.size(); ++v) {
+    if (remap[v] != UINT32_MAX)
+      memcpy(&out[remap[v] * width], &buf[v * width], width * sizeof(float));
+  }
+  buf.swap(out);
+}
+
+} // namespace
+
+void weld(vector<float> &pos, vector<float> &nor, vector<float> &tex,
+          vector<uint32_t> &indices) {
+  size_t corners = pos.size() / 3;
+  unordered_map<CornerKey, uint32_t, CornerHash> unique;
+  unique.reserve(corners);
+  vector<uint32_t> remap(corners);
+  indices.resize(corners);
+  uint32_t next = 0;
+  for (size_t c = 0; c < corners; ++c) {
+    CornerKey key = {};
+    memcpy(&key.bits[0], &pos[3 * c], 3 * sizeof(float));
+    if (!nor.empty())
+      memcpy(&key.bits[3], &nor[3 * c], 3 * sizeof(float));
+    if (!tex.empty())
+      memcpy(&key.bits[6], &tex[2 * c], 2 * sizeof(float));
+    auto it = unique.emplace(key, next);
+    if (it.second) {
+      remap[c] = next++;
+    } else {
+      remap[c] = UINT32_MAX; // a duplicate, dropped
+    }
+    indices[c] = it.first->second;
+  }
+  remapVertices(pos, 3, remap, next);
+  remapVertices(nor, 3, remap, next);
+  remapVertices(tex, 2, remap, next);
+}
+
+void optimizeVertexCache(vector<uint32_t> &indices, size_t vertexCount,
+                         int cacheSize) {
+  size_t triCount = indices.size() / 3;
+  if (triCount == 0)
+    return;
+
+  // Triangles around each vertex, packed: adjacency[offsets[v]..offsets[v+1])
+  vector<uint32_t> offsets(vertexCount + 1, 0);
+  for (uint32_t v : indices)
+    offsets[v + 1]++;
+  for (size_t v = 0; v < vertexCount; ++v)
+    offsets[v + 1] += offsets[v];
+  vector<uint32_t> adjacency(indices.size());
+  vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+  for (size_t t = 0; t < triCount; ++t) {
+    for (int k = 0; k < 3; ++k)
+      adjacency[fill[indices[3 * t + k]]++] = (uint32_t)t;
+  }
+
+  vector<uint32_t> live(vertexCount);
+  for (size_t v = 0; v < vertexCount; ++v)
+    live[v] = offsets[v + 1] - offsets[v];
+  vector<int> cacheTime(vertexCount, 0);
+  vector<bool> emitted(triCount, false);
+  vector<uint32_t> deadEnd; // recently touched vertices, the fallback
+  vector<uint32_t> candidates;
+  vector<uint32_t> out;
+  out.reserve(indices.size());
+
+  int time = cacheSize + 1;
+  size_t cursor = 0; // next vertex to try when everything else is dead
+  int fanning = 0;
+  while (fanning >= 0) {
+    candidates.clear();
+    // Emit every remaining triangle around the fanning vertex
+    for (uint32_t a = offsets[fanning]; a < offsets[fanning + 1]; ++a) {
+      uint32_t t = adjacency[a];
+      if (emitted[t])
+        continue;
+      for (int k = 0; k < 3; ++k) {
+        uint32_t v = indices[3 * t + k];
+        out.push_back(v);
+        deadEnd.push_back(v);
+        candidates.push_back(v);
+        live[v]--;
+        if (time - cacheTime[v] > cacheSize)
+          cacheTime[v] = time++;
+      }
+      emitted[t] = true;
+    }
+
+    // Next fan: the candidate that is still in the cache and will stay in
+    // it for its remaining triangles, oldest first
+    int best = -1, bestPriority = -1;
+    for (uint32_t v : candidates) {
+      if (live[v] == 0)
+        continue;
+      int priority = 0;
+      if (time - cacheTime[v] + 2 * (int)live[v] <= cacheSize)
+        priority = time - cacheTime[v];
+      if (priority > bestPriority) {
+        best = (int)v;
+        bestPriority = priority;
+      }
+    }
+    if (best < 0) {
+      while (!deadEnd.empty()) {
+        uint32_t v = deadEnd.back();
+        deadEnd.pop_back();
+        if (live[v] > 0) {
+          best = (int)v;
+          break;
+        }
+      }
+    }
+    while (best < 0 && cursor < vertexCount) {
+      if (live[cursor] > 0)
+        best = (int)cursor;
+      cursor++;
+    }
+    fanning = best;
+  }
+  indices.swap(out);
+}
+
+void optimizeVertexFetch(vector<float> &pos, vector<float> &nor,
+                         vector<float> &tex, vector<uint32_t> &indices) {
+  size_t vertexCount = pos.size() / 3;
+  vector<uint32_t> remap(vertexCount, UINT32_MAX);
+  uint32_t next = 0;
+  for (uint32_t &i : indices) {
+    if (remap[i] == UINT32_MAX)
+      remap[i] = next++;
+    i = remap[i];
+  }
+  remapVertices(pos, 3, remap, next);
+  remapVertices(nor, 3, remap, next);
+  remapVertices(tex, 2, remap, next);
+}
+
+} // namespace MeshOptimizer
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Index buffer tools for the meshes Shape loads from OBJ files, which come
+// in as one vertex per triangle corner.
+namespace MeshOptimizer {
+
+// Merges corners whose position, normal and texcoord are bit identical.
+// The arrays are rewritten to hold only the unique vertices (nor and tex
+// may be empty), indices gets one entry per original corner.
+void weld(std::vector<float> &pos, std::vector<float> &nor,
+          std::vector<float> &tex, std::vector<uint32_t> &indices);
+
+// Reorders triangles for the post-transform vertex cache with Tipsify
+// (Sander, Nehab and Barczak 2007). cacheSize is the FIFO size to plan for.
+void optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount,
+                         int cacheSize = 16);
+
+// Renumbers vertices in the order the indices first use them, so vertex
+// fetch walks the buffer forward. Same array conventions as weld.
+void optimizeVertexFetch(std::vector<float> &pos, std::vector<float> &nor,
+                         std::vector<float> &tex,
+                         std::vector<uint32_t> &indices);
+
+} // namespace MeshOptimizer
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "Sweep.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+
+// Exact sphere vs cube tests. Everything here works in the cube's own frame:
+// the cube is [-half, half]^3 at the origin, so callers bring points in with
+// the transpose of the cube's rotation (cubes are rigid, never scaled) and
+// take normals back out with the rotation itself.
+
+// How a sphere overlaps a cube: normal points out of the cube towards the
+// sphere, depth is how far the sphere has to move along it to separate
+struct Contact {
+  glm::vec3 normal = glm::vec3(0.0f);
+  float depth = 0.0f;
+};
+
+// Sphere at p (cube frame) of radius r against the cube. Only the closest
+// point on the cube counts, so a sphere near a corner but not touching it is
+// a miss, unlike a center distance test.
+inline bool sphereBox(const glm::vec3 &p, float r, float half, Contact &c) {
+  glm::vec3 q = glm::clamp(p, glm::vec3(-half), glm::vec3(half));
+  glm::vec3 d = p - q;
+  float dist2 = glm::dot(d, d);
+  if (dist2 > r * r)
+    return false;
+  if (dist2 > 1e-12f) {
+    float dist = std::sqrt(dist2);
+    c.normal = d / dist;
+    c.depth = r - dist;
+    return true;
+  }
+  // center inside the cube, push out through the nearest face
+  int axis = 0;
+  glm::vec3 gap = glm::vec3(half) - glm::abs(p);
+  if (gap.y < gap[axis])
+    axis = 1;
+  if (gap.z < gap[axis])
+    axis = 2;
+  c.normal = glm::vec3(0.0f);
+  c.normal[axis] = p[axis] < 0.0f ? -1.0f : 1.0f;
+  c.depth = r + gap[axis];
+  return true;
+}
+
+// Sphere moving from -> from + move (cube frame) against the cube, times as
+// in Sweep.h. The ray against the cube grown by r gives the first time worth
+// checking; past a face that is the contact, near an edge or corner the
+// rounded part is reached by conservative advancement (the distance to a
+// box changes no faster than the center moves, so a step of distance - r
+// never overshoots). Sets t and the contact normal if the hit is before t.
+// A start overlapping the cube counts only while moving into it.
+inline bool sweepSphereBox(const glm::vec3 &from, const glm::vec3 &move,
+                           float half, float r, float &t, glm::vec3 &normal) {
+  const int MAX_STEPS = 16;
+  const float EPS = 1e-4f;
+  float t0 = 0.0f, t1 = t;
+  int axis;
+  glm::vec3 grown(half + r);
+  if (!rayBox(from, move, -grown, grown, t0, t1, axis))
+    return false;
+  float len = glm::length(move);
+  for (int step = 0; step < MAX_STEPS; ++step) {
+    glm::vec3 p = from + move * t0;
+    Contact c;
+    if (sphereBox(p, r + EPS, half, c)) {
+      if (glm::dot(move, c.normal) >= 0.0f)
+        return false; // touching but not closing in
+      t = t0;
+      normal = c.normal;
+      return true;
+    }
+    if (len <= 0.0f)
+      return false;
+    glm::vec3 q = glm::clamp(p, glm::vec3(-half), glm::vec3(half));
+    t0 += (glm::length(p - q) - r) / len;
+    if (t0 > t1)
+      return false;
+  }
+  return false; // grazing an edge, call it a miss
+}
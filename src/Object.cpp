@@ -1,4 +1,5 @@
 #include "Object.h"
+#include <glm/gtc/matrix_transform.hpp>
 #include <random>
 
 using std::make_shared, std::shared_ptr, std::string, std::vector, glm::vec3;
@@ -6,24 +7,25 @@ using std::make_shared, std::shared_ptr, std::string, std::vector, glm::vec3;
 void Object::drawObject(std::shared_ptr<MatrixStack> &P,
                         std::shared_ptr<MatrixStack> &MV,
                         std::shared_ptr<Program> &activeProgram,
+                        const Uniform<glm::mat4> &MVHandle,
                         std::shared_ptr<Material> &activeMaterial) {
 
-  // Use MV and program
-  float minY = mesh->getMinY();
-  MV->pushMatrix();
-  MV->translate(translation);
-
-  MV->translate(0.0f, -minY, 0.0f);
-  vec3 baseCenter = mesh->getBaseCenter();
-  MV->translate(baseCenter);
-  MV->scale(this->scale);
-  MV->translate(-baseCenter);
-  // Push to ground
-
-  glUniformMatrix4fv(activeProgram->getUniform("MV"), 1, GL_FALSE,
-                     &MV->topMatrix()[0][0]);
+  // Use MV and program, no push/pop, the model matrix is kept
+  MVHandle.set(MV->topMatrix() * getModelMatrix());
   mesh->draw(activeProgram);
-  MV->popMatrix();
+}
+
+const glm::mat4 &Object::getModelMatrix() const {
+  if (modelDirty) {
+    // Push to ground, then scale about the base center
+    vec3 baseCenter = mesh->getBaseCenter();
+    vec3 offset = translation + vec3(0.0f, -mesh->getMinY(), 0.0f);
+    model = glm::translate(glm::mat4(1.0f), offset + baseCenter) *
+            glm::scale(glm::mat4(1.0f), scale) *
+            glm::translate(glm::mat4(1.0f), -baseCenter);
+    modelDirty = false;
+  }
+  return model;
 }
 
 // Parametrized constructor
@@ -44,9 +46,8 @@ Object::Object(std::shared_ptr<Shape> mesh, glm::vec3 translation,
   // Init material w/ random color
 
   // Gernerate random color (ChatGPT aid)
-  // Create a random device and seed the Mersenne Twister engine.
-  std::random_device rd;
-  std::mt19937 gen(rd());
+  // One Mersenne Twister for every object, seeded once
+  static std::mt19937 gen(std::random_device{}());
 
   // Define a uniform distribution in the range [1, 100].
   std::uniform_int_distribution<> dis(1, 100);
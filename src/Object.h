@@ -35,6 +35,9 @@ private:
   float scaleFactor;
   glm::mat4 ShearMat;
   float shearFactor;
+  // Model matrix, rebuilt on the next use after the transform changes
+  mutable glm::mat4 model = glm::mat4(1.0f);
+  mutable bool modelDirty = true;
 
   // Material
   std::shared_ptr<Material> material;
@@ -42,23 +45,34 @@ private:
 public:
   Object(std::shared_ptr<Shape> mesh, glm::vec3 translation, float rotAngle,
          glm::quat quaternion, glm::vec3 scale, float shearFactor);
+  // MVHandle is activeProgram's MV, resolved once by the caller
   void drawObject(std::shared_ptr<MatrixStack> &P,
                   std::shared_ptr<MatrixStack> &MV,
                   std::shared_ptr<Program> &activeProgram,
+                  const Uniform<glm::mat4> &MVHandle,
                   std::shared_ptr<Material> &activeMaterial);
   std::shared_ptr<Material> getMaterial() { return material; }
-  void setScale(const glm::vec3 &scale) { this->scale = scale; }
+  // Sits the mesh on the floor at translation, scaled about its base center
+  const glm::mat4 &getModelMatrix() const;
+  void setScale(const glm::vec3 &scale) {
+    if (scale != this->scale) {
+      this->scale = scale;
+      this->modelDirty = true;
+    }
+  }
   void setFactor(const float &factor) { this->scaleFactor = factor; }
   void setTranslation(const glm::vec3 &translation) {
-    this->translation = translation;
+    if (translation != this->translation) {
+      this->translation = translation;
+      this->modelDirty = true;
+    }
   };
   glm::vec3 getTranslation() { return this->translation; };
-  void setRotation(float angle) { this->rotAngle = angle; };
+  void setRotation(float angle) {
+    if (angle != this->rotAngle) {
+      this->rotAngle = angle;
+      this->modelDirty = true;
+    }
+  };
   float getFactor() { return this->scaleFactor; }
 };
-
-struct Bunny : public Object {
-  using Object::Object;
-  bool alive = true;
-  void hit() { this->alive = false; };
-};
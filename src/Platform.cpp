@@ -13,6 +13,8 @@ void Platform::createStructure(std::shared_ptr<Shape> cubeMesh, int width,
   float liftY = -bottom;
 
   // build a width × length grid at y = liftY
+  setLattice(center + vec3(0.0f, liftY, 0.0f), mat3(1.0f),
+             glm::ivec3(width, 1, length));
   for (int z = 0; z < length; ++z) {
     for (int x = 0; x < width; ++x) {
       vec3 pos = center + vec3(x * 1.0f, // assuming getSize()==1.0f
@@ -20,13 +22,13 @@ void Platform::createStructure(std::shared_ptr<Shape> cubeMesh, int width,
       mat4 model = glm::translate(mat4(1.0f), pos);
 
       // record instance matrix
-      pushBackModelMat(model);
+      CubeHandle h = pushBackModelMat(model, glm::ivec3(x, 0, z));
 
       // make a locked particle at that position
       auto p = make_shared<Particle>(cubeMesh);
       p->x = glmVec3ToEigen(vec3(model[3]));
       p->fixed = true;
-      pushToParticles(p);
+      setParticle(h, p);
     }
   }
 
@@ -35,8 +37,7 @@ void Platform::createStructure(std::shared_ptr<Shape> cubeMesh, int width,
     for (int x = 0; x < width - 1; ++x) {
       int idx0 = z * width + x;
       int idx1 = idx0 + 1;
-      pushToSprings(make_shared<Spring>(getParticleAtIdx(idx0),
-                                        getParticleAtIdx(idx1), ALPHA));
+      connectSlots(idx0, idx1, ALPHA);
     }
   }
   // connect springs along +Z
@@ -44,8 +45,7 @@ void Platform::createStructure(std::shared_ptr<Shape> cubeMesh, int width,
     for (int x = 0; x < width; ++x) {
       int idx0 = z * width + x;
       int idx1 = idx0 + width;
-      pushToSprings(make_shared<Spring>(getParticleAtIdx(idx0),
-                                        getParticleAtIdx(idx1), ALPHA));
+      connectSlots(idx0, idx1, ALPHA);
     }
   }
 
@@ -39,8 +39,10 @@ public:
     glm::vec3 bulletVelVec = playerPOV->getForward() * 35.0f;
     auto req = armament->fireArmament(
         bulletPos, bulletVelVec,
-        this->ARMAMENT_MODE); // 1 for piercing, 0 for ricochet
-    if (req) {
+        this->ARMAMENT_MODE); // 2 hit-scan, 1 piercing, 0 ricochet
+    if (req && req->type == BulletType::HITSCAN) {
+      this->bulletManager->fireRay(req->pos, req->vel);
+    } else if (req) {
       this->bulletManager->spawnBullet(req->pos, req->vel, req->type);
     };
   };
@@ -58,7 +60,8 @@ public:
   }
 
   void move(GLFWwindow *window, float dt,
-            const std::vector<std::shared_ptr<Structure>> &structures) {
+            const std::vector<std::shared_ptr<Structure>> &structures,
+            const Broadphase &broadphase) {
     // 0) get current position
     glm::vec3 pos = playerPOV->getPosition();
     const float r = COLLISION_RADIUS_XZ;
@@ -79,18 +82,27 @@ public:
     } else {
       bool hitGround = false;
       float bestY = -1e9f;
-      for (auto &s : structures) {
-        for (auto &M : s->getModelMatsStatic()) {
-          glm::vec3 c = glm::vec3(M[3]);
-          if (pos.x + r > c.x - 0.5f && pos.x - r < c.x + 0.5f &&
-              pos.z + r > c.z - 0.5f && pos.z - r < c.z + 0.5f) {
-            float topY = c.y + 0.5f;
-            if (nextY <= topY && pos.y >= topY) {
-              hitGround = true;
-              bestY = std::max(bestY, topY);
+      AABB footprint(glm::vec3(pos.x - r, nextY, pos.z - r),
+                     glm::vec3(pos.x + r, pos.y, pos.z + r));
+      // cubes whose top lies in [nextY, pos.y] have centers half a cube lower
+      AABB centers(glm::vec3(pos.x - r - 0.5f, nextY - 0.5f, pos.z - r - 0.5f),
+                   glm::vec3(pos.x + r + 0.5f, pos.y - 0.5f, pos.z + r + 0.5f));
+      // only falling can land, on the way up the slab is empty
+      if (nextY <= pos.y) {
+        broadphase.query(footprint, [&](int i) {
+          const Structure &s = *structures[i];
+          s.forEachCubeCenterInBox(centers, [&](int, const glm::vec3 &c) {
+            if (pos.x + r > c.x - 0.5f && pos.x - r < c.x + 0.5f &&
+                pos.z + r > c.z - 0.5f && pos.z - r < c.z + 0.5f) {
+              float topY = c.y + 0.5f;
+              if (nextY <= topY && pos.y >= topY) {
+                hitGround = true;
+                bestY = std::max(bestY, topY);
+              }
             }
-          }
-        }
+          });
+          return true;
+        });
       }
       if (hitGround) {
         pos.y = bestY;
@@ -128,57 +140,55 @@ public:
                    pos.y + (COLLISION_HEAD_Y - COLLISION_FOOT_Y),
                    candidate.z + r};
 
-    // **only** collide against cubes whose *top* is *above* your foot‐level
+    // One pass answers both questions: is the body blocked, and if so is
+    // there a low enough cube under the candidate to step up onto
+    const float maxStep = 0.5f;
     bool blocked = false;
-    for (auto &s : structures) {
-      for (auto &M : s->getModelMatsStatic()) {
-        glm::vec3 c = glm::vec3(M[3]);
+    float bestTopY = -1e9f;
+    AABB body(pMin, pMax);
+    AABB probe = body;
+    probe.expand(glm::vec3(candidate.x, pos.y + maxStep, candidate.z));
+    AABB centers(probe.min - glm::vec3(0.5f), probe.max + glm::vec3(0.5f));
+    broadphase.query(probe, [&](int i) {
+      const Structure &s = *structures[i];
+      s.forEachCubeCenterInBox(centers, [&](int, const glm::vec3 &c) {
         float botY = c.y - 0.5f;
         float topY = c.y + 0.5f;
 
-        // skip the platform you’re standing on:
-        if (fabs(topY - pos.y) < 1e-2f)
-          continue;
+        // step‐up candidates: cube right under the new XZ, top within reach
+        if (candidate.x > c.x - 0.5f && candidate.x < c.x + 0.5f &&
+            candidate.z > c.z - 0.5f && candidate.z < c.z + 0.5f &&
+            topY > pos.y && topY <= pos.y + maxStep) {
+          bestTopY = std::max(bestTopY, topY);
+        }
+
+        // **only** collide against cubes whose *top* is *above* your
+        // foot‐level, skip the platform you’re standing on:
+        if (blocked || fabs(topY - pos.y) < 1e-2f)
+          return;
 
         // AABB vs your candidate box:
         if (pMin.x < c.x + 0.5f && pMax.x > c.x - 0.5f && pMin.y < topY &&
             pMax.y > botY && pMin.z < c.z + 0.5f && pMax.z > c.z - 0.5f) {
           blocked = true;
-          break;
         }
-      }
-      if (blocked)
-        break;
-    }
+      });
+      return true;
+    });
 
     if (!blocked) {
       // no wall in the way
       pos.x = candidate.x;
       pos.z = candidate.z;
-    } else {
-      // try a little step‐up
-      const float maxStep = 0.5f;
-      float bestTopY = -1e9f;
-      for (auto &s : structures) {
-        for (auto &M : s->getModelMatsStatic()) {
-          glm::vec3 c = glm::vec3(M[3]);
-          float topY = c.y + 0.5f;
-          if (candidate.x > c.x - 0.5f && candidate.x < c.x + 0.5f &&
-              candidate.z > c.z - 0.5f && candidate.z < c.z + 0.5f &&
-              topY > pos.y && topY <= pos.y + maxStep) {
-            bestTopY = std::max(bestTopY, topY);
-          }
-        }
-      }
-      if (bestTopY > -1e8f) {
-        pos.x = candidate.x;
-        pos.z = candidate.z;
-        pos.y = bestTopY;
-        vertVel = 0.0f;
-        grounded = true;
-      }
-      // else stay in place
+    } else if (bestTopY > -1e8f) {
+      // a little step‐up
+      pos.x = candidate.x;
+      pos.z = candidate.z;
+      pos.y = bestTopY;
+      vertVel = 0.0f;
+      grounded = true;
     }
+    // else stay in place
 
     playerPOV->setPosition(pos);
   }
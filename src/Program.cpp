@@ -2,8 +2,14 @@
 
 #include <iostream>
 #include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <vector>
 
 #include "GLSL.h"
+#include "GLState.h"
 
 using namespace std;
 
@@ -11,6 +17,9 @@ Program::Program() :
 	vShaderName(""),
 	fShaderName(""),
 	pid(0),
+	VS(0),
+	FS(0),
+	fromCache(false),
 	verbose(true)
 {
 	
@@ -27,22 +36,99 @@ void Program::setShaderNames(const string &v, const string &f)
 	fShaderName = f;
 }
 
+void Program::setBinaryCacheDir(const string &dir)
+{
+	binaryCacheDir = dir;
+	if(!dir.empty()) {
+		std::error_code ec;
+		std::filesystem::create_directories(dir, ec);
+	}
+}
+
+// FNV-1a, plenty to tell shader sources apart
+static uint64_t hashString(uint64_t h, const string &s)
+{
+	for(unsigned char c : s) {
+		h ^= c;
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+static string glString(GLenum name)
+{
+	const GLubyte *s = glGetString(name);
+	return s ? (const char *)s : "";
+}
+
+static string readSource(const string &name)
+{
+	char *text = GLSL::textFileRead(name.c_str());
+	string source = text ? text : "";
+	free(text);
+	return source;
+}
+
 bool Program::init()
 {
-	GLint rc;
+	return start() && finish();
+}
+
+bool Program::start()
+{
+	string vSource = readSource(vShaderName);
+	string fSource = readSource(fShaderName);
+
+	fromCache = false;
+	cachePath.clear();
+	if(!binaryCacheDir.empty() && GLEW_ARB_get_program_binary) {
+		// a driver update changes the binary format, so it is part of the key
+		uint64_t h = 14695981039346656037ull;
+		h = hashString(h, vSource);
+		h = hashString(h, fSource);
+		h = hashString(h, glString(GL_VENDOR));
+		h = hashString(h, glString(GL_RENDERER));
+		h = hashString(h, glString(GL_VERSION));
+		char name[32];
+		snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)h);
+		cachePath = binaryCacheDir + "/" + name;
+		if(loadBinary()) {
+			fromCache = true;
+			return true;
+		}
+	}
 	
 	// Create shader handles
-	GLuint VS = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FS = glCreateShader(GL_FRAGMENT_SHADER);
+	VS = glCreateShader(GL_VERTEX_SHADER);
+	FS = glCreateShader(GL_FRAGMENT_SHADER);
 	
-	// Read shader sources
-	const char *vshader = GLSL::textFileRead(vShaderName.c_str());
-	const char *fshader = GLSL::textFileRead(fShaderName.c_str());
+	const char *vshader = vSource.c_str();
+	const char *fshader = fSource.c_str();
 	glShaderSource(VS, 1, &vshader, NULL);
 	glShaderSource(FS, 1, &fshader, NULL);
 	
-	// Compile vertex shader
+	// Compile and link. No status queries here, those would wait for the
+	// driver; finish() does them.
 	glCompileShader(VS);
+	glCompileShader(FS);
+	pid = glCreateProgram();
+	glAttachShader(pid, VS);
+	glAttachShader(pid, FS);
+	if(!cachePath.empty()) {
+		glProgramParameteri(pid, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+	glLinkProgram(pid);
+	return true;
+}
+
+bool Program::finish()
+{
+	if(fromCache) {
+		return true;
+	}
+	GLint rc;
+	
+	// Compile vertex shader
 	glGetShaderiv(VS, GL_COMPILE_STATUS, &rc);
 	if(!rc) {
 		if(isVerbose()) {
@@ -53,7 +139,6 @@ bool Program::init()
 	}
 	
 	// Compile fragment shader
-	glCompileShader(FS);
 	glGetShaderiv(FS, GL_COMPILE_STATUS, &rc);
 	if(!rc) {
 		if(isVerbose()) {
@@ -63,11 +148,7 @@ bool Program::init()
 		return false;
 	}
 	
-	// Create the program and link
-	pid = glCreateProgram();
-	glAttachShader(pid, VS);
-	glAttachShader(pid, FS);
-	glLinkProgram(pid);
+	// Link
 	glGetProgramiv(pid, GL_LINK_STATUS, &rc);
 	if(!rc) {
 		if(isVerbose()) {
@@ -76,19 +157,96 @@ bool Program::init()
 		}
 		return false;
 	}
+
+	// The program keeps what it needs
+	glDetachShader(pid, VS);
+	glDetachShader(pid, FS);
+	glDeleteShader(VS);
+	glDeleteShader(FS);
+	VS = FS = 0;
+
+	if(!cachePath.empty()) {
+		saveBinary();
+	}
 	
 	GLSL::checkError(GET_FILE_LINE);
 	return true;
 }
 
+// Cache file: the GLenum binary format, then the binary
+bool Program::loadBinary()
+{
+	FILE *fp = fopen(cachePath.c_str(), "rb");
+	if(fp == NULL) {
+		return false;
+	}
+	GLenum format = 0;
+	vector<char> binary;
+	if(fread(&format, sizeof(format), 1, fp) == 1) {
+		fseek(fp, 0, SEEK_END);
+		long size = ftell(fp) - (long)sizeof(format);
+		fseek(fp, sizeof(format), SEEK_SET);
+		if(size > 0) {
+			binary.resize(size);
+			binary.resize(fread(binary.data(), 1, size, fp));
+		}
+	}
+	fclose(fp);
+	if(binary.empty()) {
+		return false;
+	}
+
+	pid = glCreateProgram();
+	glProgramBinary(pid, format, binary.data(), (GLsizei)binary.size());
+	GLint rc;
+	glGetProgramiv(pid, GL_LINK_STATUS, &rc);
+	if(!rc) {
+		// rejected by the driver, build from source and overwrite it
+		glDeleteProgram(pid);
+		pid = 0;
+		return false;
+	}
+	return true;
+}
+
+void Program::saveBinary()
+{
+	GLint length = 0;
+	glGetProgramiv(pid, GL_PROGRAM_BINARY_LENGTH, &length);
+	if(length <= 0) {
+		return;
+	}
+	vector<char> binary(length);
+	GLenum format = 0;
+	GLsizei written = 0;
+	glGetProgramBinary(pid, length, &written, &format, binary.data());
+	if(written <= 0) {
+		return;
+	}
+	// written next to it and renamed, a crash never leaves half a binary
+	string tmp = cachePath + ".tmp";
+	FILE *fp = fopen(tmp.c_str(), "wb");
+	if(fp == NULL) {
+		return;
+	}
+	bool ok = fwrite(&format, sizeof(format), 1, fp) == 1 &&
+	          fwrite(binary.data(), 1, written, fp) == (size_t)written;
+	ok = fclose(fp) == 0 && ok;
+	if(ok) {
+		std::rename(tmp.c_str(), cachePath.c_str());
+	} else {
+		std::remove(tmp.c_str());
+	}
+}
+
 void Program::bind()
 {
-	glUseProgram(pid);
+	glState.useProgram(pid);
 }
 
 void Program::unbind()
 {
-	glUseProgram(0);
+	glState.useProgram(0);
 }
 
 void Program::addAttribute(const string &name)
@@ -101,6 +259,18 @@ void Program::addUniform(const string &name)
 	uniforms[name] = glGetUniformLocation(pid, name.c_str());
 }
 
+void Program::bindBlock(const string &name, GLuint binding)
+{
+	GLuint index = glGetUniformBlockIndex(pid, name.c_str());
+	if(index == GL_INVALID_INDEX) {
+		if(isVerbose()) {
+			cout << name << " is not a uniform block" << endl;
+		}
+		return;
+	}
+	glUniformBlockBinding(pid, index, binding);
+}
+
 GLint Program::getAttribute(const string &name) const
 {
 	map<string,GLint>::const_iterator attribute = attributes.find(name.c_str());
@@ -7,6 +7,30 @@
 
 #define GLEW_STATIC
 #include <GL/glew.h>
+#include <glm/glm.hpp>
+
+inline void setUniform(GLint loc, int v) { glUniform1i(loc, v); }
+inline void setUniform(GLint loc, float v) { glUniform1f(loc, v); }
+inline void setUniform(GLint loc, const glm::vec3 &v)
+{
+	glUniform3fv(loc, 1, &v[0]);
+}
+inline void setUniform(GLint loc, const glm::mat4 &v)
+{
+	glUniformMatrix4fv(loc, 1, GL_FALSE, &v[0][0]);
+}
+
+/**
+ * A uniform location resolved once, so setting it needs no name lookup.
+ * Uniforms the shader doesn't have (-1) are skipped. Sets the currently bound
+ * program, like glUniform*.
+ */
+template <class T>
+struct Uniform
+{
+	GLint loc = -1;
+	void set(const T &v) const { if(loc >= 0) setUniform(loc, v); }
+};
 
 /**
  * An OpenGL Program (vertex and fragment shaders)
@@ -22,6 +46,16 @@ public:
 	
 	void setShaderNames(const std::string &v, const std::string &f);
 	virtual bool init();
+	// init() in two halves, so several programs can build at once: start()
+	// every program, then finish() each. start() loads the cached binary if
+	// there is one, else kicks off compile and link without waiting on them.
+	// finish() waits, reports errors and fills the cache on a miss.
+	bool start();
+	bool finish();
+	bool isFromCache() const { return fromCache; }
+	// Where linked binaries are kept, keyed by source and driver. Empty (the
+	// default) turns the cache off.
+	static void setBinaryCacheDir(const std::string &dir);
 	virtual void bind();
 	virtual void unbind();
 
@@ -29,13 +63,33 @@ public:
 	void addUniform(const std::string &name);
 	GLint getAttribute(const std::string &name) const;
 	GLint getUniform(const std::string &name) const;
+	// Points the named uniform block at a binding point, see UniformBlocks.h
+	void bindBlock(const std::string &name, GLuint binding);
+
+	// Typed handle to any uniform, look it up once and keep it
+	template <class T>
+	Uniform<T> uniform(const std::string &name) const
+	{
+		Uniform<T> u;
+		u.loc = getUniform(name);
+		return u;
+	}
 	
 protected:
 	std::string vShaderName;
 	std::string fShaderName;
 	
 private:
+	bool loadBinary();
+	void saveBinary();
+
+	static inline std::string binaryCacheDir;
+
 	GLuint pid;
+	GLuint VS;
+	GLuint FS;
+	std::string cachePath; // empty when not caching
+	bool fromCache;
 	std::map<std::string,GLint> attributes;
 	std::map<std::string,GLint> uniforms;
 	bool verbose;
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Broadphase.h"
+#include "Structure.h"
+#include <memory>
+#include <vector>
+
+// Ray queries over every structure. The broadphase narrows the structures to
+// the ones whose box the segment's box touches, each of those walks its own
+// lattice (Structure::raycast).
+
+// First cube along origin + dir * t for t in [0, maxDist]. dir need not be
+// unit length, hit is reset and hit.t is a world distance either way.
+// Returns the index of the structure hit, or -1.
+inline int
+raycastWorld(const std::vector<std::shared_ptr<Structure>> &structures,
+             const Broadphase &broadphase, const glm::vec3 &origin,
+             const glm::vec3 &dir, float maxDist, RayHit &hit) {
+  float len = glm::length(dir);
+  if (len <= 0.0f || maxDist <= 0.0f)
+    return -1;
+  glm::vec3 unit = dir / len;
+  hit = RayHit();
+  hit.t = maxDist;
+  int hitStructure = -1;
+  AABB segment(glm::min(origin, origin + unit * maxDist),
+               glm::max(origin, origin + unit * maxDist));
+  broadphase.query(segment, [&](int s) {
+    if (structures[s]->raycast(origin, unit, hit))
+      hitStructure = s;
+    return true;
+  });
+  return hitStructure;
+}
+
+// True when no cube lies between a and b, for AI sight lines and sound
+// occlusion
+inline bool hasLineOfSight(
+    const std::vector<std::shared_ptr<Structure>> &structures,
+    const Broadphase &broadphase, const glm::vec3 &a, const glm::vec3 &b) {
+  glm::vec3 d = b - a;
+  float dist = glm::length(d);
+  if (dist <= 0.0f)
+    return true;
+  glm::vec3 unit = d / dist;
+  RayHit hit;
+  hit.t = dist;
+  AABB segment(glm::min(a, b), glm::max(a, b));
+  bool blocked = false;
+  broadphase.query(segment, [&](int s) {
+    blocked = structures[s]->raycast(a, unit, hit);
+    return !blocked; // any cube will do, stop at the first
+  });
+  return !blocked;
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "FrameStats.h"
+#include "GLState.h"
+#include "Program.h"
+#include <GL/glew.h>
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// SCENE is the opaque 3D world: depth test on, no blending. OVERLAY is the
+// HUD on top of it: no depth test, alpha blending, drawn in submission order.
+enum class RenderPass : uint8_t { SCENE = 0, OVERLAY = 1 };
+
+// One draw. prog null means the fixed function pipeline (program 0). texture
+// and vao are bound before draw runs; 0 leaves binding to the callback, which
+// must then bind through glState (VaoCache, Texture and Program already do).
+struct DrawPacket {
+  uint64_t key = 0;
+  RenderPass pass = RenderPass::SCENE;
+  Program *prog = nullptr;
+  GLuint texture = 0;
+  int unit = 0;
+  GLuint vao = 0;
+  std::function<void()> draw;
+};
+
+// Systems submit packets during the frame, flush sorts them and runs them so
+// that everything using the same program, then texture, then VAO is drawn
+// together, opaque packets front to back inside that. The sort key, high to
+// low bits:
+//   pass (2) | program (8) | texture (16) | vao (16) | depth (22)
+// Overlay packets use pass | submission order, HUD layering is what the
+// caller says. Binds that would not change anything are dropped by glState.
+class RenderQueue {
+private:
+  struct Setup {
+    const Program *prog;
+    std::function<void()> fn;
+    bool done;
+  };
+
+  std::vector<DrawPacket> packets;
+  std::vector<Setup> setups;
+  std::vector<const Program *> programIds; // dense ids for the key, kept
+  uint32_t order = 0;
+
+  uint64_t programId(const Program *prog) {
+    if (!prog)
+      return 0;
+    auto it = std::find(programIds.begin(), programIds.end(), prog);
+    if (it == programIds.end())
+      it = programIds.insert(programIds.end(), prog);
+    return (uint64_t)(it - programIds.begin()) + 1;
+  }
+
+  static void applyPass(RenderPass pass) {
+    if (pass == RenderPass::SCENE) {
+      glEnable(GL_DEPTH_TEST);
+      glDisable(GL_BLEND);
+    } else {
+      glDisable(GL_DEPTH_TEST);
+      glEnable(GL_BLEND);
+      glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    }
+  }
+
+  void runSetup(const Program *prog) {
+    for (auto &s : setups) {
+      if (s.prog == prog && !s.done) {
+        s.fn();
+        s.done = true;
+      }
+    }
+  }
+
+public:
+  static constexpr uint32_t DEPTH_MAX = (1u << 22) - 1;
+
+  // Quantized view depth for the key, near first
+  static uint32_t depthKey(float viewDepth, float farPlane) {
+    float t = std::min(std::max(viewDepth / farPlane, 0.0f), 1.0f);
+    return (uint32_t)(t * DEPTH_MAX);
+  };
+
+  // fn runs once this frame, right after prog is first bound, and sets the
+  // uniforms shared by all its packets (P, MV, lights, material...)
+  void setProgramSetup(const std::shared_ptr<Program> &prog,
+                       std::function<void()> fn) {
+    setups.push_back({prog.get(), std::move(fn), false});
+  };
+
+  void submit(RenderPass pass, const std::shared_ptr<Program> &prog,
+              GLuint texture, GLuint vao, uint32_t depth,
+              std::function<void()> draw, int unit = 0) {
+    DrawPacket p;
+    p.pass = pass;
+    p.prog = prog.get();
+    p.texture = texture;
+    p.unit = unit;
+    p.vao = vao;
+    p.draw = std::move(draw);
+    p.key = (uint64_t)pass << 62;
+    if (pass == RenderPass::OVERLAY) {
+      p.key |= order++;
+    } else {
+      p.key |= (programId(p.prog) & 0xff) << 54;
+      p.key |= (uint64_t)(texture & 0xffff) << 38;
+      p.key |= (uint64_t)(vao & 0xffff) << 22;
+      p.key |= std::min(depth, DEPTH_MAX);
+    }
+    packets.push_back(std::move(p));
+  };
+
+  size_t size() const { return this->packets.size(); };
+
+  // Sort, draw and empty the queue
+  void flush() {
+    std::stable_sort(packets.begin(), packets.end(),
+                     [](const DrawPacket &a, const DrawPacket &b) {
+                       return a.key < b.key;
+                     });
+    bool first = true;
+    RenderPass pass = RenderPass::SCENE;
+    for (auto &p : packets) {
+      if (first || p.pass != pass) {
+        applyPass(p.pass);
+        pass = p.pass;
+        first = false;
+      }
+      if (p.prog) {
+        p.prog->bind();
+        runSetup(p.prog);
+      } else {
+        glState.useProgram(0);
+      }
+      if (p.texture)
+        glState.bindTexture(p.unit, p.texture);
+      if (p.vao)
+        glState.bindVertexArray(p.vao);
+      p.draw();
+    }
+    frameStats.current.drawPackets += (int)packets.size();
+    packets.clear();
+    setups.clear();
+    order = 0;
+  };
+};
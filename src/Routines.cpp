@@ -5,12 +5,10 @@ using std::make_shared, std::shared_ptr, std::string, std::vector, glm::vec3,
 
 // Draw grid
 // TODO: BUILDING DIMENSIONS 15m x 5m
-void drawGrid(shared_ptr<Program> &activeProgram, shared_ptr<MatrixStack> &P,
-              shared_ptr<MatrixStack> &MV) {
-  glUniformMatrix4fv(activeProgram->getUniform("P"), 1, GL_FALSE,
-                     glm::value_ptr(P->topMatrix()));
-  glUniformMatrix4fv(activeProgram->getUniform("MV"), 1, GL_FALSE,
-                     glm::value_ptr(MV->topMatrix()));
+void drawGrid(shared_ptr<Program> &activeProgram, const DrawUniforms &uniforms,
+              shared_ptr<MatrixStack> &P, shared_ptr<MatrixStack> &MV) {
+  // P comes from the frame uniform block
+  uniforms.MV.set(MV->topMatrix());
   glLineWidth(2.0f);
   float x0 = -100.0f;
   float x1 = 100.0f;
@@ -98,14 +96,62 @@ void drawFrustrum(std::shared_ptr<Program> &activeProgram,
 }
 
 // Create shaders
-void createShaders(string RESOURCE_DIR, vector<shared_ptr<Program>> &programs) {
+void createShaders(string RESOURCE_DIR, vector<shared_ptr<Program>> &programs,
+                   vector<DrawUniforms> &drawUniforms) {
+  double startTime = glfwGetTime();
 
   // Blinn_phong
   std::shared_ptr<Program> blingProg = make_shared<Program>();
   blingProg->setShaderNames(RESOURCE_DIR + "bling_phong_vert.glsl",
                             RESOURCE_DIR + "bling_phong_frag_mult_lights.glsl");
-  blingProg->setVerbose(true);
-  blingProg->init();
+
+  // Default
+  std::shared_ptr<Program> prog = make_shared<Program>();
+  prog->setShaderNames(RESOURCE_DIR + "normal_vert.glsl",
+                       RESOURCE_DIR + "normal_frag.glsl");
+
+  // HUD Shader
+  std::shared_ptr<Program> progHUD = make_shared<Program>();
+  progHUD->setShaderNames(RESOURCE_DIR + "hud_vert.glsl",
+                          RESOURCE_DIR + "hud_frag.glsl");
+
+  // Imported from lab 9
+  std::shared_ptr<Program> blingProgNoTexture = make_shared<Program>();
+  blingProgNoTexture->setShaderNames(
+      RESOURCE_DIR + "bling_phong_vert_orig.glsl",
+      RESOURCE_DIR + "bling_phong_frag_mult_lights_orig.glsl");
+
+  // Shader for text rendering
+  std::shared_ptr<Program> TextShader = std::make_shared<Program>();
+  TextShader->setShaderNames(RESOURCE_DIR + "text_vert.glsl",
+                             RESOURCE_DIR + "text_frag.glsl");
+
+  std::shared_ptr<Program> blingClassic = make_shared<Program>();
+  blingClassic->setShaderNames(RESOURCE_DIR + "bling_classic_vert.glsl",
+                               RESOURCE_DIR +
+                                   "bling_phong_frag_mult_lights_orig.glsl");
+
+  // Every compile and link is queued before waiting on any of them, so a
+  // driver with parallel compile builds them side by side. Programs in the
+  // binary cache skip compiling altogether.
+  std::vector<std::shared_ptr<Program>> all = {
+      blingProg, prog, progHUD, blingProgNoTexture, TextShader, blingClassic};
+  if (GLEW_KHR_parallel_shader_compile)
+    glMaxShaderCompilerThreadsKHR(0xFFFFFFFF); // as many as the driver likes
+  for (auto &p : all) {
+    p->setVerbose(true);
+    p->start();
+  }
+  int cached = 0;
+  for (auto &p : all) {
+    p->finish();
+    cached += p->isFromCache();
+  }
+  std::cout << "Shaders: " << all.size() << " programs in "
+            << (glfwGetTime() - startTime) * 1000.0 << " ms, " << cached
+            << " from the binary cache" << std::endl;
+
+  // Blinn_phong
   blingProg->addAttribute("aPos");
   blingProg->addAttribute("aNor");
   // blingProg->addAttribute("aTex");
@@ -114,44 +160,28 @@ void createShaders(string RESOURCE_DIR, vector<shared_ptr<Program>> &programs) {
   blingProg->addUniform("texture0");
   blingProg->addUniform("texture1");
   blingProg->addUniform("texture2");
-  blingProg->addUniform("lightsPos");
-  blingProg->addUniform("lightsColor");
-  blingProg->addAttribute("aInstMat0");
-  blingProg->addAttribute("aInstMat1");
-  blingProg->addAttribute("aInstMat2");
-  blingProg->addAttribute("aInstMat3");
-  blingProg->addUniform("MV");
-  blingProg->addUniform("P");
+  blingProg->addAttribute("aInstPosScale");
+  blingProg->addAttribute("aInstRot");
   blingProg->addUniform("normalMatrix"); // New uniform for transforming normals
   blingProg->addUniform("ka");
-  blingProg->addUniform("kd");
-  blingProg->addUniform("ks");
-  blingProg->addUniform("ke");
   blingProg->addUniform("t");
-  blingProg->addUniform("s");
+  // camera, lights and material come from the uniform blocks
+  blingProg->bindBlock("Frame", FRAME_BINDING);
+  blingProg->bindBlock("Materials", MATERIALS_BINDING);
+  blingProg->addUniform("material");
   blingProg->setVerbose(false);
   programs.push_back(blingProg);
 
   // Default
-  std::shared_ptr<Program> prog = make_shared<Program>();
-  prog->setShaderNames(RESOURCE_DIR + "normal_vert.glsl",
-                       RESOURCE_DIR + "normal_frag.glsl");
-  prog->setVerbose(true);
-  prog->init();
   prog->addAttribute("aPos");
   prog->addAttribute("aNor");
   prog->addUniform("MV");
-  prog->addUniform("P");
+  prog->bindBlock("Frame", FRAME_BINDING);
   prog->setVerbose(false);
 
   programs.push_back(prog);
 
   // HUD Shader
-  std::shared_ptr<Program> progHUD = make_shared<Program>();
-  progHUD->setShaderNames(RESOURCE_DIR + "hud_vert.glsl",
-                          RESOURCE_DIR + "hud_frag.glsl");
-  progHUD->setVerbose(true);
-  progHUD->init();
   progHUD->addAttribute("aPos");
   progHUD->addAttribute("aNor");
   progHUD->addUniform("MV");
@@ -166,63 +196,48 @@ void createShaders(string RESOURCE_DIR, vector<shared_ptr<Program>> &programs) {
   programs.push_back(progHUD);
 
   // Imported from lab 9
-  std::shared_ptr<Program> blingProgNoTexture = make_shared<Program>();
-  blingProgNoTexture->setShaderNames(
-      RESOURCE_DIR + "bling_phong_vert_orig.glsl",
-      RESOURCE_DIR + "bling_phong_frag_mult_lights_orig.glsl");
-  blingProgNoTexture->setVerbose(true);
-  blingProgNoTexture->init();
   blingProgNoTexture->addAttribute("aPos");
   blingProgNoTexture->addAttribute("aNor");
-  blingProgNoTexture->addUniform("lightsPos");
-  blingProgNoTexture->addUniform("lightsColor");
   blingProgNoTexture->addUniform("isBullet");
-  blingProgNoTexture->addAttribute("aInstMat0");
-  blingProgNoTexture->addAttribute("aInstMat1");
-  blingProgNoTexture->addAttribute("aInstMat2");
-  blingProgNoTexture->addAttribute("aInstMat3");
-  blingProgNoTexture->addUniform("MV");
-  blingProgNoTexture->addUniform("P");
+  blingProgNoTexture->addAttribute("aInstPosScale");
+  blingProgNoTexture->addAttribute("aInstRot");
+  blingProgNoTexture->addAttribute("aInstColor");
   blingProgNoTexture->addUniform(
       "normalMatrix"); // New uniform for transforming normals
-  blingProgNoTexture->addUniform("ke");
-  blingProgNoTexture->addUniform("kd");
-  blingProgNoTexture->addUniform("ks");
   blingProgNoTexture->addUniform("t");
-  blingProgNoTexture->addUniform("s");
+  blingProgNoTexture->bindBlock("Frame", FRAME_BINDING);
+  blingProgNoTexture->bindBlock("Materials", MATERIALS_BINDING);
+  blingProgNoTexture->addUniform("material");
   blingProgNoTexture->setVerbose(false);
   programs.push_back(blingProgNoTexture);
 
   // Shader for text rendering
-  std::shared_ptr<Program> TextShader = std::make_shared<Program>();
-  TextShader->setShaderNames(RESOURCE_DIR + "text_vert.glsl",
-                             RESOURCE_DIR + "text_frag.glsl");
-  TextShader->init();
   TextShader->addAttribute("aPos");
   TextShader->addAttribute("aTex");
+  TextShader->addAttribute("aColor");
   TextShader->addUniform("text");
-  TextShader->addUniform("textColor");
   TextShader->addUniform("projection");
+  TextShader->setVerbose(false);
   programs.push_back(TextShader);
 
-  std::shared_ptr<Program> blingClassic = make_shared<Program>();
-  blingClassic->setShaderNames(RESOURCE_DIR + "bling_classic_vert.glsl",
-                               RESOURCE_DIR +
-                                   "bling_phong_frag_mult_lights_orig.glsl");
-  blingClassic->setVerbose(true);
-  blingClassic->init();
   blingClassic->addUniform("MV");
-  blingClassic->addUniform("P");
   blingClassic->addAttribute("aPos");
   blingClassic->addAttribute("aNor");
-  blingClassic->addUniform("lightsPos");
-  blingClassic->addUniform("lightsColor");
-  blingClassic->addUniform("ke");
-  blingClassic->addUniform("kd");
-  blingClassic->addUniform("ks");
-  blingClassic->addUniform("s");
+  blingClassic->bindBlock("Frame", FRAME_BINDING);
+  blingClassic->bindBlock("Materials", MATERIALS_BINDING);
+  blingClassic->addUniform("material");
   blingClassic->setVerbose(false);
   programs.push_back(blingClassic);
+
+  // Looked up once here, draws set them through the handles
+  for (auto &p : programs) {
+    DrawUniforms u;
+    u.MV = p->uniform<glm::mat4>("MV");
+    u.material = p->uniform<int>("material");
+    u.tileScale = p->uniform<float>("tileScale");
+    u.texture0 = p->uniform<int>("texture0");
+    drawUniforms.push_back(u);
+  }
 }
 
 // Help from ChatGPT for reasoning
@@ -307,20 +322,21 @@ void drawSceneObjects(std::vector<std::shared_ptr<Object>> &objects,
                       std::shared_ptr<MatrixStack> &P,
                       std::shared_ptr<MatrixStack> &MV,
                       std::shared_ptr<Program> &activeProgram,
+                      const DrawUniforms &uniforms,
                       std::shared_ptr<Material> &activeMaterial, double t) {
+  Uniform<vec3> kd = activeProgram->uniform<vec3>("kd");
   for (size_t i = 0; i < objects.size(); i++) {
 
     shared_ptr<Object> obj = objects[i];
     // Load obj's material here (color)
     shared_ptr<Material> material = obj->getMaterial();
-    glUniform3f(activeProgram->getUniform("kd"), material->getMaterialKD().x,
-                material->getMaterialKD().y, material->getMaterialKD().z);
+    kd.set(material->getMaterialKD());
 
     // Use t to interpolate values from 0.5 to 1 (oscillating)
     float scaleSet = obj->getFactor() + 0.25f * sin(t + i);
 
     obj->setScale(vec3(scaleSet, scaleSet, scaleSet));
-    obj->drawObject(P, MV, activeProgram, activeMaterial);
+    obj->drawObject(P, MV, activeProgram, uniforms.MV, activeMaterial);
   }
 }
 
@@ -1,7 +1,12 @@
+#include "Broadphase.h"
 #include "BulletManager.h"
 #include "GLM_EIGEN_COMPATIBILITY_LAYER.h"
 #include "Platform.h"
+#include "RenderQueue.h"
+#include "UniformBlocks.h"
+#include "StaticBatcher.h"
 #include "Structure.h"
+#include "TargetSystem.h"
 #include "Wall.h"
 #include "common.h"
 #include <cassert>
@@ -31,8 +36,17 @@
 #include "Texture.h"
 // clang-format on
 
+// The per draw uniforms of one program, resolved once in createShaders and
+// kept next to it. Ones the program doesn't have stay -1 and are skipped.
+struct DrawUniforms {
+  Uniform<glm::mat4> MV;
+  Uniform<int> material;
+  Uniform<float> tileScale;
+  Uniform<int> texture0;
+};
+
 void drawGrid(std::shared_ptr<Program> &activeProgram,
-              std::shared_ptr<MatrixStack> &P,
+              const DrawUniforms &uniforms, std::shared_ptr<MatrixStack> &P,
               std::shared_ptr<MatrixStack> &MV);
 void drawFrustrum(std::shared_ptr<Program> &activeProgram,
                   std::shared_ptr<Camera> &camera,
@@ -40,8 +54,10 @@ void drawFrustrum(std::shared_ptr<Program> &activeProgram,
                   std::shared_ptr<MatrixStack> &MV,
                   std::shared_ptr<Shape> &frustrum, int width, int height);
 void centerCam(std::shared_ptr<MatrixStack> &MV); // Applies transformation
+// drawUniforms gets one entry per program, in the same order
 void createShaders(std::string RESOURCE_DIR,
-                   std::vector<std::shared_ptr<Program>> &programs);
+                   std::vector<std::shared_ptr<Program>> &programs,
+                   std::vector<DrawUniforms> &drawUniforms);
 void createMaterials(std::vector<std::shared_ptr<Material>> &materials);
 void texturesBind(std::shared_ptr<Program> &prog,
                   std::shared_ptr<Texture> &texture0,
@@ -59,91 +75,108 @@ void drawSceneObjects(std::vector<std::shared_ptr<Object>> &objects,
                       std::shared_ptr<MatrixStack> &P,
                       std::shared_ptr<MatrixStack> &MV,
                       std::shared_ptr<Program> &activeProgram,
+                      const DrawUniforms &uniforms,
                       std::shared_ptr<Material> &activeMaterial, double t);
 
-inline void drawLevel(std::shared_ptr<Program> &activeProg,
-                      std::shared_ptr<MatrixStack> &P,
-                      std::shared_ptr<MatrixStack> &MV, glm::mat4 &T,
-                      std::vector<std::shared_ptr<Light>> &lights,
-                      std::vector<glm::vec3> &viewLightPositions,
-                      std::vector<glm::vec3> &lightsColors,
-                      std::shared_ptr<Material> &activeMaterial,
-                      std::vector<std::shared_ptr<Material>> &materials,
-                      std::vector<std::shared_ptr<Structure>> &structures,
-                      std::vector<std::shared_ptr<Texture>> &textures,
-                      int width, int height, float dt) {
-
-  // Back to original shader
-  glUniformMatrix4fv(activeProg->getUniform("P"), 1, GL_FALSE,
-                     glm::value_ptr(P->topMatrix()));
-  glUniformMatrix4fv(activeProg->getUniform("MV"), 1, GL_FALSE,
-                     glm::value_ptr(MV->topMatrix()));
-  glUniformMatrix3fv(activeProg->getUniform("T"), 1, GL_FALSE,
-                     glm::value_ptr(T));
+static constexpr float BUNNY_RADIUS = 1.0f; // tweak to fit your mesh
 
-  // Now pass the transformed positions to the shader.
-  glUniform3fv(activeProg->getUniform("lightsPos"), lights.size(),
-               glm::value_ptr(viewLightPositions[0]));
-  glUniform3fv(activeProg->getUniform("lightsColor"), lights.size(),
-               glm::value_ptr(lightsColors[0]));
+// Greedy meshed surfaces for every structure that can have one
+inline void
+setStructureMeshMode(std::vector<std::shared_ptr<Structure>> &structures,
+                     bool on) {
+  for (auto &structure : structures) {
+    structure->setMeshMode(on);
+  }
+}
 
-  // Set material uniforms from activeMaterial
-  glUniform3f(activeProg->getUniform("ke"), activeMaterial->getMaterialKE().x,
-              activeMaterial->getMaterialKE().y,
-              activeMaterial->getMaterialKE().z);
-  glUniform3f(activeProg->getUniform("kd"), activeMaterial->getMaterialKD().x,
-              activeMaterial->getMaterialKD().y,
-              activeMaterial->getMaterialKD().z);
-  glUniform3f(activeProg->getUniform("ks"), activeMaterial->getMaterialKS().x,
-              activeMaterial->getMaterialKS().y,
-              activeMaterial->getMaterialKS().z);
-  glUniform1f(activeProg->getUniform("s"), activeMaterial->getMaterialS());
-  textures[0]->bind(activeProg->getUniform("texture0"));
-  MV->pushMatrix();
-  for (auto structure : structures) {
-    structure->renderStructure(activeProg);
-    structure->updateDebris(dt);
-    structure->renderDebris(activeProg);
+// Distance along the view axis, for the render queue depth key
+inline float viewDepth(const glm::mat4 &MV, const glm::vec3 &p) {
+  return -(MV * glm::vec4(p, 1.0f)).z;
+}
+
+// Steps the debris and queues the level: the static batch, every structure's
+// debris and the rubble, all textured with the brick wall. Camera and lights
+// come from the frame uniform block.
+inline void queueLevel(RenderQueue &queue, std::shared_ptr<Program> &activeProg,
+                       const DrawUniforms &uniforms,
+                       std::shared_ptr<MatrixStack> &MV, int materialIndex,
+                       float tileScale,
+                       std::vector<std::shared_ptr<Structure>> &structures,
+                       StaticBatcher &staticBatcher, RubbleBuffer &rubble,
+                       const Frustum &frustum,
+                       std::vector<std::shared_ptr<Texture>> &textures,
+                       float farPlane, float dt) {
+  std::shared_ptr<Program> prog = activeProg;
+  std::shared_ptr<Texture> tex = textures[0];
+  glm::mat4 MVm = MV->topMatrix();
+  queue.setProgramSetup(prog, [=]() {
+    uniforms.material.set(materialIndex);
+    uniforms.tileScale.set(tileScale);
+    uniforms.texture0.set(tex->getUnit());
+  });
+
+  GLuint texID = tex->getID();
+  int unit = tex->getUnit();
+  // every static cube in the level, one batch
+  queue.submit(
+      RenderPass::SCENE, prog, texID, 0, 0,
+      [prog, &staticBatcher, &frustum]() { staticBatcher.draw(prog, frustum); },
+      unit);
+  for (auto &structure : structures) {
+    structure->updateDebris(dt, rubble);
+    if (structure->getDebris().empty())
+      continue;
+    uint32_t depth = RenderQueue::depthKey(
+        viewDepth(MVm, structure->getBounds().center()), farPlane);
+    queue.submit(
+        RenderPass::SCENE, prog, texID, 0, depth,
+        [prog, structure, &frustum]() {
+          structure->renderDebris(prog, frustum);
+        },
+        unit);
+  }
+  if (rubble.getCount() > 0) {
+    queue.submit(
+        RenderPass::SCENE, prog, texID, 0, RenderQueue::DEPTH_MAX,
+        [prog, &rubble]() { rubble.draw(prog); }, unit);
   }
-  textures[0]->unbind();
-  MV->popMatrix();
 };
 
 inline void drawGridLines(std::shared_ptr<Program> &activeProg,
+                          const DrawUniforms &uniforms,
                           std::shared_ptr<MatrixStack> &P,
                           std::shared_ptr<MatrixStack> &MV, glm::mat4 &T) {
-  drawGrid(activeProg, P, MV);
+  drawGrid(activeProg, uniforms, P, MV);
 };
 
-inline void drawBullets(std::shared_ptr<Program> &activeProg,
-                        std::shared_ptr<MatrixStack> &P,
-                        std::shared_ptr<MatrixStack> &MV, float dt,
-                        std::shared_ptr<BulletManager> &bulletManager,
-                        std::vector<std::shared_ptr<Structure>> &structures) {
-  // advance & fracture
-  MV->pushMatrix();
-  glUniformMatrix4fv(activeProg->getUniform("MV"), 1, GL_FALSE,
-                     glm::value_ptr(MV->topMatrix()));
-  bulletManager->renderBullets(activeProg);
-  MV->popMatrix();
+inline void queueBullets(RenderQueue &queue,
+                         std::shared_ptr<Program> &activeProg,
+                         const DrawUniforms &uniforms,
+                         int materialIndex,
+                         std::shared_ptr<BulletManager> &bulletManager,
+                         const Frustum &frustum) {
+  std::shared_ptr<Program> prog = activeProg;
+  queue.setProgramSetup(prog,
+                        [=]() { uniforms.material.set(materialIndex); });
+  queue.submit(RenderPass::SCENE, prog, 0, 0, 0,
+               [prog, bulletManager, &frustum]() {
+                 bulletManager->renderBullets(prog, frustum);
+               });
 }
 
-inline void drawBunnies(std::shared_ptr<Program> &activeProg,
-                        std::shared_ptr<MatrixStack> &P,
-                        std::shared_ptr<MatrixStack> &MV,
-                        std::vector<std::shared_ptr<Light>> &lights,
-                        std::vector<glm::vec3> &viewLightPositions,
-                        std::vector<glm::vec3> &lightsColors,
-                        std::shared_ptr<Material> &activeMaterial,
-                        std::vector<std::shared_ptr<Material>> &materials,
-                        std::vector<std::shared_ptr<Bunny>> &bunnies, int width,
-                        int height) {
-  // std::cout << "Drawing " << bunnies.size() << " bunnies\n";
-  for (auto &bunny : bunnies) {
-    if (bunny->alive) {
-      bunny->drawObject(P, MV, activeProg, activeMaterial);
-    }
-  }
+// All targets in one instanced packet
+inline void queueTargets(RenderQueue &queue,
+                         std::shared_ptr<Program> &activeProg,
+                         const DrawUniforms &uniforms,
+                         int materialIndex, TargetSystem &targets,
+                         const Frustum &frustum) {
+  std::shared_ptr<Program> prog = activeProg;
+  queue.setProgramSetup(prog,
+                        [=]() { uniforms.material.set(materialIndex); });
+  queue.submit(RenderPass::SCENE, prog, 0, 0, 0,
+               [prog, &targets, &frustum]() {
+                 targets.render(prog, frustum);
+               });
 }
 
 inline void
@@ -432,89 +465,56 @@ inline void initMaze(std::vector<std::shared_ptr<Structure>> &structures,
   structures.push_back(wallFortyNine);
 }
 
-inline void initBunnies(std::vector<std::shared_ptr<Bunny>> &bunnies,
-                        std::shared_ptr<Shape> &bunny, int Y) {
-
-  // Create bunnies
-  for (int i = 0; i < 8; i++) {
-    std::shared_ptr<Bunny> bunnyTarget = std::make_shared<Bunny>(
-        bunny, glm::vec3(0.0f), 0.0f, glm::vec3(0.0f), glm::vec3(1.0f), 0.0f);
-    bunnyTarget->setScale(glm::vec3(1.0f));
-    bunnies.push_back(bunnyTarget);
+inline void initBunnies(TargetSystem &targets, int Y) {
+  // Three floors of eight, same spots on every floor
+  const glm::vec2 spots[8] = {{38.0f, 38.0f}, {12.0f, 14.0f}, {17.3f, 6.5f},
+                              {12.0f, 2.0f},  {27.4f, 32.8f}, {32.0f, 12.0f},
+                              {20.0f, 32.0f}, {17.9f, 17.2f}};
+  float floorY = Y;
+  for (int f = 0; f < 3; f++) {
+    for (const glm::vec2 &xz : spots) {
+      targets.add(glm::vec3(xz.x, floorY, xz.y));
+    }
+    floorY -= 15.0f;
   }
-  // Now move bunnies to their locations
-  bunnies[0]->setTranslation(glm::vec3(38.0f, Y, 38.0f));
-  bunnies[1]->setTranslation(glm::vec3(12.0f, Y, 14.0f));
-  bunnies[2]->setTranslation(glm::vec3(17.3f, Y, 6.5f));
-  bunnies[3]->setTranslation(glm::vec3(12.0f, Y, 2.0f));
-  bunnies[4]->setTranslation(glm::vec3(27.4f, Y, 32.8f));
-  bunnies[5]->setTranslation(glm::vec3(32.0f, Y, 12.0f));
-  bunnies[6]->setTranslation(glm::vec3(20.0f, Y, 32.0f));
-  bunnies[7]->setTranslation(glm::vec3(17.9f, Y, 17.2f));
-
-  float Y_new = Y - 15.0f;
-  for (int i = 0; i < 8; i++) {
-    std::shared_ptr<Bunny> bunnyTarget = std::make_shared<Bunny>(
-        bunny, glm::vec3(0.0f), 0.0f, glm::vec3(0.0f), glm::vec3(1.0f), 0.0f);
-    bunnyTarget->setScale(glm::vec3(1.0f));
-    bunnies.push_back(bunnyTarget);
+}
+
+// Stress test: count more targets scattered over the three floors
+inline void scatterBunnies(TargetSystem &targets, int count, int Y) {
+  std::mt19937 gen(1234); // same layout every run
+  std::uniform_real_distribution<float> xz(1.0f, 39.0f);
+  std::uniform_int_distribution<int> floor(0, 2);
+  for (int i = 0; i < count; i++) {
+    targets.add(glm::vec3(xz(gen), Y - 15.0f * floor(gen), xz(gen)));
   }
-  // Now move bunnies to their locations
-  bunnies[8]->setTranslation(glm::vec3(38.0f, Y_new, 38.0f));
-  bunnies[9]->setTranslation(glm::vec3(12.0f, Y_new, 14.0f));
-  bunnies[10]->setTranslation(glm::vec3(17.3f, Y_new, 6.5f));
-  bunnies[11]->setTranslation(glm::vec3(12.0f, Y_new, 2.0f));
-  bunnies[12]->setTranslation(glm::vec3(27.4f, Y_new, 32.8f));
-  bunnies[13]->setTranslation(glm::vec3(32.0f, Y_new, 12.0f));
-  bunnies[14]->setTranslation(glm::vec3(20.0f, Y_new, 32.0f));
-  bunnies[15]->setTranslation(glm::vec3(17.9f, Y_new, 17.2f));
-
-  Y_new = Y_new - 15.0f;
-  for (int i = 0; i < 8; i++) {
-    std::shared_ptr<Bunny> bunnyTarget = std::make_shared<Bunny>(
-        bunny, glm::vec3(0.0f), 0.0f, glm::vec3(0.0f), glm::vec3(1.0f), 0.0f);
-    bunnyTarget->setScale(glm::vec3(1.0f));
-    bunnies.push_back(bunnyTarget);
+}
+
+// Broadphase over the level, rebuilt after the structures are created
+inline void
+buildStructureBroadphase(Broadphase &broadphase,
+                         std::vector<std::shared_ptr<Structure>> &structures) {
+  std::vector<AABB> bounds;
+  bounds.reserve(structures.size());
+  for (auto &structure : structures) {
+    bounds.push_back(structure->getBounds());
   }
-  // Now move bunnies to their locations
-  bunnies[16]->setTranslation(glm::vec3(38.0f, Y_new, 38.0f));
-  bunnies[17]->setTranslation(glm::vec3(12.0f, Y_new, 14.0f));
-  bunnies[18]->setTranslation(glm::vec3(17.3f, Y_new, 6.5f));
-  bunnies[19]->setTranslation(glm::vec3(12.0f, Y_new, 2.0f));
-  bunnies[20]->setTranslation(glm::vec3(27.4f, Y_new, 32.8f));
-  bunnies[21]->setTranslation(glm::vec3(32.0f, Y_new, 12.0f));
-  bunnies[22]->setTranslation(glm::vec3(20.0f, Y_new, 32.0f));
-  bunnies[23]->setTranslation(glm::vec3(17.9f, Y_new, 17.2f));
+  broadphase.build(bounds);
 }
 
-inline void bunnyCollisions(std::shared_ptr<BulletManager> &bulletManager,
-                            std::vector<std::shared_ptr<Bunny>> &bunnies,
-                            int &NUM_BUNNIES) {
-  const float bulletRadius = 0.5f; // same as in your manager
-  const float bunnyRadius = 1.0f;  // tweak to fit your mesh
-  auto &bullets = bulletManager->getBullets();
-  for (auto &b : bullets) {
-    if (!b.alive)
-      continue;
-    for (auto &bun : bunnies) {
-      if (!bun->alive)
-        continue;
-      float d = glm::distance(b.position, bun->getTranslation());
-      if (d < bulletRadius + bunnyRadius) {
-        // collision!
-        bun->hit();
-        b.alive = false;
-        NUM_BUNNIES--;
-        break; // stop testing this bullet
-      }
+// Pick up structures changed by rotate()/fracturedCube() since last frame
+inline void
+refitStructureBroadphase(Broadphase &broadphase,
+                         std::vector<std::shared_ptr<Structure>> &structures) {
+  for (size_t i = 0; i < structures.size(); ++i) {
+    if (structures[i]->isBoundsDirty()) {
+      broadphase.setBounds((int)i, structures[i]->getBounds());
     }
   }
+  broadphase.refit();
 }
 
+// Fixed function, drawn in the overlay pass (no depth test)
 inline void drawReticle(int width, int height) {
-
-  glDisable(GL_DEPTH_TEST);
-
   // save current matrices
   glMatrixMode(GL_PROJECTION);
   glPushMatrix();
@@ -548,6 +548,4 @@ inline void drawReticle(int width, int height) {
   glMatrixMode(GL_PROJECTION);
   glPopMatrix();
   glMatrixMode(GL_MODELVIEW);
-
-  glEnable(GL_DEPTH_TEST);
 }
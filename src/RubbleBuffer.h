@@ -0,0 +1,89 @@
+#pragma once
+
+#include "FrameStats.h"
+#include "Program.h"
+#include "Shape.h"
+#include "VaoCache.h"
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+// Debris that came to rest, baked into one fixed size instance buffer. A
+// baked cube is uploaded once and never touched again; when the buffer is
+// full the oldest slot is overwritten (ring order).
+class RubbleBuffer {
+private:
+  std::shared_ptr<Shape> cubeMesh;
+  std::vector<glm::vec4> instances; // posScale, see InstanceData.h
+  GLuint instanceVBO = 0;
+  size_t capacity = 0;
+  size_t next = 0;  // ring write position
+  size_t count = 0; // filled slots, <= capacity
+  // slots written since the last upload, [pendingFirst, next) modulo capacity
+  size_t pendingFirst = 0;
+  size_t pending = 0;
+
+  void upload(size_t first, size_t n) {
+    glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(glm::vec4),
+                    n * sizeof(glm::vec4), instances.data() + first);
+    countUpload(n * sizeof(glm::vec4));
+  }
+
+public:
+  RubbleBuffer() = default;
+
+  // Called from main before the window goes, like StaticBatcher::release
+  void release() {
+    if (instanceVBO)
+      glDeleteBuffers(1, &instanceVBO);
+    instanceVBO = 0;
+  };
+
+  void init(std::shared_ptr<Shape> cubeMesh, size_t capacity) {
+    this->cubeMesh = cubeMesh;
+    this->capacity = capacity;
+    instances.assign(capacity, glm::vec4(0.0f));
+    if (!instanceVBO)
+      glGenBuffers(1, &instanceVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(glm::vec4), nullptr,
+                 GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    next = count = pendingFirst = pending = 0;
+  };
+
+  void bake(const glm::vec3 &pos, float size) {
+    if (capacity == 0)
+      return;
+    instances[next] = glm::vec4(pos, size);
+    if (pending == 0)
+      pendingFirst = next;
+    pending = std::min(pending + 1, capacity);
+    next = (next + 1) % capacity;
+    count = std::min(count + 1, capacity);
+  };
+
+  size_t getCount() const { return this->count; };
+
+  void draw(const std::shared_ptr<Program> &prog) {
+    if (count == 0)
+      return;
+
+    if (pending > 0) {
+      // only the newly baked slots, split in two if they wrapped around
+      glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+      size_t tail = std::min(pending, capacity - pendingFirst);
+      upload(pendingFirst, tail);
+      if (pending > tail)
+        upload(0, pending - tail);
+      pending = 0;
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    const VaoCache::Entry &vao =
+        vaoCache.get(VertexSource::of(*cubeMesh), *prog, instanceVBO,
+                     InstanceFormat::POS_SCALE);
+    VaoCache::drawInstanced(vao, cubeMesh->getDrawCount(), (GLsizei)count);
+    countInstances(count, count);
+  };
+};
@@ -1,24 +1,48 @@
 #include "Shape.h"
 #include <algorithm>
+#include <cstring>
 #include <iostream>
 
 #include "GLSL.h"
+#include "GLState.h"
+#include "MeshOptimizer.h"
 #include "Program.h"
+#include "VaoCache.h"
 #include "pch.h"
 
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tiny_obj_loader.h"
 
 using namespace std;
 
-Shape::Shape() : posBufID(0), norBufID(0), texBufID(0) {}
+Shape::Shape() : vertexBufID(0), indexBufID(0) {}
 
 Shape::~Shape() {}
 
 void Shape::loadMesh(const string &meshName) {
+  posStorage.clear();
+  norStorage.clear();
+  texStorage.clear();
+  indexStorage.clear();
+  mapping = nullptr;
+
+  // A compiled copy is mapped as is, no parsing and no copies before upload
+  MeshArrays cached;
+  if (MeshCache::load(meshName, mapping, cached)) {
+    posBuf = cached.pos;
+    norBuf = cached.nor;
+    texBuf = cached.tex;
+    indexBuf = cached.indices;
+    boundsMin = cached.boundsMin;
+    boundsMax = cached.boundsMax;
+    updateBounds();
+    return;
+  }
+
   // Load geometry
   tinyobj::attrib_t attrib;
   std::vector<tinyobj::shape_t> shapes;
@@ -43,17 +67,17 @@ void Shape::loadMesh(const string &meshName) {
         for (size_t v = 0; v < fv; v++) {
           // access to vertex
           tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
-          posBuf.push_back(attrib.vertices[3 * idx.vertex_index + 0]);
-          posBuf.push_back(attrib.vertices[3 * idx.vertex_index + 1]);
-          posBuf.push_back(attrib.vertices[3 * idx.vertex_index + 2]);
+          posStorage.push_back(attrib.vertices[3 * idx.vertex_index + 0]);
+          posStorage.push_back(attrib.vertices[3 * idx.vertex_index + 1]);
+          posStorage.push_back(attrib.vertices[3 * idx.vertex_index + 2]);
           if (!attrib.normals.empty()) {
-            norBuf.push_back(attrib.normals[3 * idx.normal_index + 0]);
-            norBuf.push_back(attrib.normals[3 * idx.normal_index + 1]);
-            norBuf.push_back(attrib.normals[3 * idx.normal_index + 2]);
+            norStorage.push_back(attrib.normals[3 * idx.normal_index + 0]);
+            norStorage.push_back(attrib.normals[3 * idx.normal_index + 1]);
+            norStorage.push_back(attrib.normals[3 * idx.normal_index + 2]);
           }
           if (!attrib.texcoords.empty()) {
-            texBuf.push_back(attrib.texcoords[2 * idx.texcoord_index + 0]);
-            texBuf.push_back(attrib.texcoords[2 * idx.texcoord_index + 1]);
+            texStorage.push_back(attrib.texcoords[2 * idx.texcoord_index + 0]);
+            texStorage.push_back(attrib.texcoords[2 * idx.texcoord_index + 1]);
           } else {
             // Generate UVs from vertex position (assuming the mesh is roughly
             // in [-1,1])
@@ -78,8 +102,8 @@ void Shape::loadMesh(const string &meshName) {
               u = (x + 1.0f) / 2.0f;
               v = (y + 1.0f) / 2.0f;
             }
-            texBuf.push_back(u);
-            texBuf.push_back(v);
+            texStorage.push_back(u);
+            texStorage.push_back(v);
           }
         }
         index_offset += fv;
@@ -88,22 +112,49 @@ void Shape::loadMesh(const string &meshName) {
       }
     }
   }
+  if (posStorage.empty())
+    return;
+
+  // Share the corners that are the same vertex, then order the triangles so
+  // the shared vertices are still in the post-transform cache when reused
+  MeshOptimizer::weld(posStorage, norStorage, texStorage, indexStorage);
+  size_t vertexCount = posStorage.size() / 3;
+  MeshOptimizer::optimizeVertexCache(indexStorage, vertexCount);
+  MeshOptimizer::optimizeVertexFetch(posStorage, norStorage, texStorage,
+                                     indexStorage);
+
+  posBuf = Span<float>(posStorage.data(), posStorage.size());
+  norBuf = Span<float>(norStorage.data(), norStorage.size());
+  texBuf = Span<float>(texStorage.data(), texStorage.size());
+  indexBuf = Span<uint32_t>(indexStorage.data(), indexStorage.size());
+
+  boundsMin = glm::vec3(posBuf[0], posBuf[1], posBuf[2]);
+  boundsMax = boundsMin;
+  for (size_t i = 0; i < posBuf.size(); i += 3) {
+    glm::vec3 v(posBuf[i], posBuf[i + 1], posBuf[i + 2]);
+    boundsMin = glm::min(boundsMin, v);
+    boundsMax = glm::max(boundsMax, v);
+  }
+  updateBounds();
+
+  MeshArrays arrays;
+  arrays.pos = posBuf;
+  arrays.nor = norBuf;
+  arrays.tex = texBuf;
+  arrays.indices = indexBuf;
+  arrays.boundsMin = boundsMin;
+  arrays.boundsMax = boundsMax;
+  MeshCache::save(meshName, arrays);
 }
 
 void Shape::fitToUnitBox() {
   // Scale the vertex positions so that they fit within [-1, +1] in all three
-  // dimensions.
-  glm::vec3 vmin(posBuf[0], posBuf[1], posBuf[2]);
-  glm::vec3 vmax(posBuf[0], posBuf[1], posBuf[2]);
-  for (int i = 0; i < (int)posBuf.size(); i += 3) {
-    glm::vec3 v(posBuf[i], posBuf[i + 1], posBuf[i + 2]);
-    vmin.x = min(vmin.x, v.x);
-    vmin.y = min(vmin.y, v.y);
-    vmin.z = min(vmin.z, v.z);
-    vmax.x = max(vmax.x, v.x);
-    vmax.y = max(vmax.y, v.y);
-    vmax.z = max(vmax.z, v.z);
-  }
+  // dimensions. Bounds came with the mesh, no pass over it to find them.
+  // A mapped mesh is private to us, the writes never reach the cache file.
+  if (posBuf.empty())
+    return;
+  glm::vec3 vmin = boundsMin;
+  glm::vec3 vmax = boundsMax;
   glm::vec3 center = 0.5f * (vmin + vmax);
   glm::vec3 diff = vmax - vmin;
   float diffmax = diff.x;
@@ -115,124 +166,115 @@ void Shape::fitToUnitBox() {
     posBuf[i + 1] = (posBuf[i + 1] - center.y) * scale;
     posBuf[i + 2] = (posBuf[i + 2] - center.z) * scale;
   }
+  boundsMin = (vmin - center) * scale;
+  boundsMax = (vmax - center) * scale;
+  updateBounds();
 }
 
 void Shape::init() {
-  // VAO for shape
-  glGenVertexArrays(1, &vao);
-  glBindVertexArray(vao);
-
-  // Send the position array to the GPU
-  glGenBuffers(1, &posBufID);
-  glBindBuffer(GL_ARRAY_BUFFER, posBufID);
-  glBufferData(GL_ARRAY_BUFFER, posBuf.size() * sizeof(float), &posBuf[0],
-               GL_STATIC_DRAW);
-
-  // Send the normal array to the GPU
-  if (!norBuf.empty()) {
-    glGenBuffers(1, &norBufID);
-    glBindBuffer(GL_ARRAY_BUFFER, norBufID);
-    glBufferData(GL_ARRAY_BUFFER, norBuf.size() * sizeof(float), &norBuf[0],
-                 GL_STATIC_DRAW);
+  // Vertex layouts live in the VAO cache, this only uploads the buffers.
+  // Attributes are interleaved into one buffer, packed if we can.
+  bool hasNor = !norBuf.empty(), hasTex = !texBuf.empty();
+  layout = Layout();
+  layout.quantized =
+      quantizeVertices &&
+      (GLEW_VERSION_3_0 || GLEW_ARB_half_float_vertex) &&
+      (GLEW_VERSION_3_3 || GLEW_ARB_vertex_type_2_10_10_10_rev);
+  int posSize = layout.quantized ? 8 : 12; // 3 halves padded to 4
+  int norSize = layout.quantized ? 4 : 12;
+  int texSize = layout.quantized ? 4 : 8;
+  layout.stride = posSize;
+  if (hasNor) {
+    layout.norOffset = layout.stride;
+    layout.stride += norSize;
+  }
+  if (hasTex) {
+    layout.texOffset = layout.stride;
+    layout.stride += texSize;
   }
 
-  // Send the texture array to the GPU
-  if (!texBuf.empty()) {
-    glGenBuffers(1, &texBufID);
-    glBindBuffer(GL_ARRAY_BUFFER, texBufID);
-    glBufferData(GL_ARRAY_BUFFER, texBuf.size() * sizeof(float), &texBuf[0],
-                 GL_STATIC_DRAW);
+  size_t n = getVertexCount();
+  vector<unsigned char> vertices(n * layout.stride);
+  for (size_t i = 0; i < n; ++i) {
+    unsigned char *v = &vertices[i * layout.stride];
+    if (layout.quantized) {
+      uint16_t pos[4] = {glm::packHalf1x16(posBuf[3 * i]),
+                         glm::packHalf1x16(posBuf[3 * i + 1]),
+                         glm::packHalf1x16(posBuf[3 * i + 2]), 0};
+      memcpy(v, pos, sizeof(pos));
+      if (hasNor) {
+        glm::vec3 nor(norBuf[3 * i], norBuf[3 * i + 1], norBuf[3 * i + 2]);
+        uint32_t packed = glm::packSnorm3x10_1x2(glm::vec4(nor, 0.0f));
+        memcpy(v + layout.norOffset, &packed, sizeof(packed));
+      }
+      if (hasTex) {
+        uint16_t tex[2] = {glm::packHalf1x16(texBuf[2 * i]),
+                           glm::packHalf1x16(texBuf[2 * i + 1])};
+        memcpy(v + layout.texOffset, tex, sizeof(tex));
+      }
+    } else {
+      memcpy(v, &posBuf[3 * i], 3 * sizeof(float));
+      if (hasNor)
+        memcpy(v + layout.norOffset, &norBuf[3 * i], 3 * sizeof(float));
+      if (hasTex)
+        memcpy(v + layout.texOffset, &texBuf[2 * i], 2 * sizeof(float));
+    }
   }
 
-  // Unbind the arrays
+  // Send the vertex array to the GPU
+  glGenBuffers(1, &vertexBufID);
+  glBindBuffer(GL_ARRAY_BUFFER, vertexBufID);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size(), vertices.data(),
+               GL_STATIC_DRAW);
   glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindVertexArray(0);
+
+  // Send the index array to the GPU. The element binding is VAO state, so
+  // step off whatever VAO was left bound first.
+  if (!indexBuf.empty()) {
+    glState.bindVertexArray(0);
+    glGenBuffers(1, &indexBufID);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufID);
+    if (hasShortIndices()) {
+      vector<uint16_t> shorts(indexBuf.begin(), indexBuf.end());
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER, shorts.size() * sizeof(uint16_t),
+                   shorts.data(), GL_STATIC_DRAW);
+    } else {
+      // 32 bit indices go up straight from the mapped cache
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBuf.size() * sizeof(uint32_t),
+                   indexBuf.data(), GL_STATIC_DRAW);
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  }
 
   GLSL::checkError(GET_FILE_LINE);
 }
 
 void Shape::draw(const shared_ptr<Program> prog) const {
-  glBindVertexArray(vao);
-
-  // debugging
-  GLint cur = 0;
-  glGetIntegerv(GL_CURRENT_PROGRAM, &cur);
-  assert(cur != 0 && "no program bound in Shape::draw!");
-
-  // Bind position buffer
-  int h_pos = prog->getAttribute("aPos");
-  glEnableVertexAttribArray(h_pos);
-  glBindBuffer(GL_ARRAY_BUFFER, posBufID);
-  glVertexAttribPointer(h_pos, 3, GL_FLOAT, GL_FALSE, 0, (const void *)0);
-
-  // Bind normal buffer
-  int h_nor = prog->getAttribute("aNor");
-  if (h_nor != -1 && norBufID != 0) {
-    glEnableVertexAttribArray(h_nor);
-    glBindBuffer(GL_ARRAY_BUFFER, norBufID);
-    glVertexAttribPointer(h_nor, 3, GL_FLOAT, GL_FALSE, 0, (const void *)0);
-  }
-
-  // Bind texcoords buffer
-  int h_tex = prog->getAttribute("aTex");
-  if (h_tex != -1 && texBufID != 0) {
-    glEnableVertexAttribArray(h_tex);
-    glBindBuffer(GL_ARRAY_BUFFER, texBufID);
-    glVertexAttribPointer(h_tex, 2, GL_FLOAT, GL_FALSE, 0, (const void *)0);
-  }
+  // debugging, the shadow state saves a glGet round trip
+  assert(glState.program != 0 && "no program bound in Shape::draw!");
 
-  // Draw
-  glBindVertexArray(vao);        // bind your VAO
-  int count = posBuf.size() / 3; // number of indices to be rendered
-  glDrawArrays(GL_TRIANGLES, 0, count);
-  glBindVertexArray(0);
-
-  // Disable and unbind
-  if (h_tex != -1) {
-    glDisableVertexAttribArray(h_tex);
-  }
-  if (h_nor != -1) {
-    glDisableVertexAttribArray(h_nor);
-  }
-  glDisableVertexAttribArray(h_pos);
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  // Layout for this program was resolved once, just bind and draw
+  const VaoCache::Entry &vao = vaoCache.get(VertexSource::of(*this), *prog);
+  glState.bindVertexArray(vao.vao);
+  if (vao.indexType)
+    glDrawElements(GL_TRIANGLES, getDrawCount(), vao.indexType, (void *)0);
+  else
+    glDrawArrays(GL_TRIANGLES, 0, getVertexCount());
 
   GLSL::checkError(GET_FILE_LINE);
 }
 
-// For scaling objs
-float Shape::getMinY() const {
-  // Assume posBuf holds [x0, y0, z0, x1, y1, z1, ...]
-  float minY = posBuf[1]; // start with the first vertex's y
-  for (size_t i = 1; i < posBuf.size(); i += 3) {
-    minY = std::min(minY, posBuf[i]);
-  }
-  return minY;
-}
-
-// Help with ChatGPT for this one
-glm::vec3 Shape::getBaseCenter() const {
-  if (posBuf.empty())
-    return glm::vec3(0.0f);
-  float minX = posBuf[0], maxX = posBuf[0];
-  float minY = posBuf[1]; // bottom
-  float minZ = posBuf[2], maxZ = posBuf[2];
+// Everything derived from the box, plus the bounding sphere around its
+// center. Runs once per load (and fit), the getters below just return these.
+void Shape::updateBounds() {
+  baseCenter = glm::vec3(0.5f * (boundsMin.x + boundsMax.x), boundsMin.y,
+                         0.5f * (boundsMin.z + boundsMax.z));
+  sphereCenter = 0.5f * (boundsMin + boundsMax);
+  float r2 = 0.0f;
   for (size_t i = 0; i < posBuf.size(); i += 3) {
-    float x = posBuf[i];
-    float y = posBuf[i + 1];
-    float z = posBuf[i + 2];
-    if (x < minX)
-      minX = x;
-    if (x > maxX)
-      maxX = x;
-    if (y < minY)
-      minY = y;
-    if (z < minZ)
-      minZ = z;
-    if (z > maxZ)
-      maxZ = z;
+    glm::vec3 d = glm::vec3(posBuf[i], posBuf[i + 1], posBuf[i + 2]) -
+                  sphereCenter;
+    r2 = std::max(r2, glm::dot(d, d));
   }
-  float centerX = (minX + maxX) / 2.0f;
-  float centerZ = (minZ + maxZ) / 2.0f;
-  return glm::vec3(centerX, minY, centerZ);
+  sphereRadius = sqrtf(r2);
 }
@@ -2,6 +2,8 @@
 #ifndef SHAPE_H
 #define SHAPE_H
 
+#include "MeshCache.h"
+#include "Span.h"
 #include <glm/glm.hpp>
 #include <memory>
 #include <string>
@@ -11,39 +13,85 @@ class Program;
 
 enum class ShapeType { SPHERE, CUBE, BUNNY, TEAPOT };
 /**
- * A shape defined by a list of triangles
- * - posBuf should be of length 3*ntris
- * - norBuf should be of length 3*ntris (if normals are available)
- * - texBuf should be of length 2*ntris (if texture coords are available)
- * posBufID, norBufID, and texBufID are OpenGL buffer identifiers.
+ * A shape defined by an indexed list of triangles
+ * - posBuf should be of length 3*nverts
+ * - norBuf should be of length 3*nverts (if normals are available)
+ * - texBuf should be of length 2*nverts (if texture coords are available)
+ * - indexBuf should be of length 3*ntris
+ * Identical corners are welded when the OBJ is loaded, and the triangles are
+ * ordered for the post-transform vertex cache.
+ * The buffers are views, either into the mapped mesh cache file or into our
+ * own storage when the mesh was parsed from the OBJ. On the GPU the vertices
+ * are interleaved in vertexBufID, see Layout.
  */
 class Shape {
 public:
+  // Where compiled meshes are kept, empty (the default) parses every time
+  static void setMeshCacheDir(const std::string &dir) {
+    MeshCache::setDir(dir);
+  };
+  // true when the last loadMesh came from the cache
+  bool isFromCache() const { return this->mapping != nullptr; };
+  // Pack vertices into half float positions and uvs and 10:10:10:2
+  // normals (16 bytes instead of 32) for shapes init'ed after this. On by
+  // default, needs GL 3.3 or the half float and 2_10_10_10 extensions.
+  static void setQuantize(bool q) { quantizeVertices = q; };
+
+  // Where each attribute sits in the interleaved vertex buffer, offsets in
+  // bytes and -1 when the mesh has no such attribute. Positions are at 0.
+  struct Layout {
+    bool quantized = false;
+    int stride = 0;
+    int norOffset = -1;
+    int texOffset = -1;
+  };
+
   Shape();
   virtual ~Shape();
   void loadMesh(const std::string &meshName);
   void fitToUnitBox();
   void init();
   void draw(const std::shared_ptr<Program> prog) const;
-  float getMinY() const; // To flush to floor
-  glm::vec3 getBaseCenter() const;
+  // Bounds are worked out when the mesh is loaded, these don't touch the
+  // vertices
+  float getMinY() const { return boundsMin.y; }; // To flush to floor
+  glm::vec3 getBaseCenter() const { return baseCenter; };
+  const glm::vec3 &getBoundsMin() const { return boundsMin; };
+  const glm::vec3 &getBoundsMax() const { return boundsMax; };
+  const glm::vec3 &getSphereCenter() const { return sphereCenter; };
+  float getSphereRadius() const { return sphereRadius; };
   void setType(ShapeType shapeType) { this->type = shapeType; };
   ShapeType getType() { return this->type; };
-  // For cube instancing
-  GLuint getVAO() const { return vao; }
   int getVertexCount() const { return posBuf.size() / 3; }
-  unsigned getPosBufID() { return posBufID; };
-  unsigned getNorBufID() { return norBufID; };
-  unsigned getTexBufID() { return texBufID; };
+  // For cube instancing, elements per draw
+  int getDrawCount() const {
+    return indexBuf.empty() ? getVertexCount() : (int)indexBuf.size();
+  }
+  const Layout &getLayout() const { return layout; };
+  unsigned getVertexBufID() const { return vertexBufID; };
+  unsigned getIndexBufID() const { return indexBufID; };
+  // 16 bit indices when every vertex fits
+  bool hasShortIndices() const { return getVertexCount() <= 65536; };
 
 private:
-  unsigned int vao;
-  std::vector<float> posBuf;
-  std::vector<float> norBuf;
-  std::vector<float> texBuf;
-  unsigned posBufID;
-  unsigned norBufID;
-  unsigned texBufID;
+  void updateBounds();
+
+  Span<float> posBuf;
+  Span<float> norBuf;
+  Span<float> texBuf;
+  Span<uint32_t> indexBuf;
+  // backing for the views above, one of these is used
+  std::shared_ptr<MappedFile> mapping;
+  std::vector<float> posStorage, norStorage, texStorage;
+  std::vector<uint32_t> indexStorage;
+  glm::vec3 boundsMin = glm::vec3(0.0f), boundsMax = glm::vec3(0.0f);
+  glm::vec3 baseCenter = glm::vec3(0.0f); // center of the bottom face
+  glm::vec3 sphereCenter = glm::vec3(0.0f);
+  float sphereRadius = 0.0f;
+  static inline bool quantizeVertices = true;
+  Layout layout;
+  unsigned vertexBufID;
+  unsigned indexBufID;
   ShapeType type;
 };
 
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+
+// Non-owning view over contiguous data (we are on C++17, no std::span)
+template <typename T> class Span {
+private:
+  T *ptr = nullptr;
+  size_t count = 0;
+
+public:
+  Span() = default;
+  Span(T *ptr, size_t count) : ptr(ptr), count(count) {};
+
+  T *begin() const { return ptr; };
+  T *end() const { return ptr + count; };
+  T *data() const { return ptr; };
+  size_t size() const { return count; };
+  bool empty() const { return count == 0; };
+  T &operator[](size_t i) const {
+    assert(i < count);
+    return ptr[i];
+  };
+};
+
+// Fixed capacity collector for query results, lives on the stack so the
+// per-frame collision path never touches the heap. Extra results past N are
+// dropped and flagged.
+template <typename T, int N> class FixedHits {
+private:
+  T items[N];
+  int count = 0;
+  bool overflowed = false;
+
+public:
+  void push(const T &v) {
+    if (count < N)
+      items[count++] = v;
+    else
+      overflowed = true;
+  };
+  void clear() {
+    count = 0;
+    overflowed = false;
+  };
+
+  T *begin() { return items; };
+  T *end() { return items + count; };
+  const T *begin() const { return items; };
+  const T *end() const { return items + count; };
+  int size() const { return count; };
+  bool empty() const { return count == 0; };
+  bool overflow() const { return overflowed; };
+  T &operator[](int i) {
+    assert(i < count);
+    return items[i];
+  };
+};
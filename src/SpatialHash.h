@@ -0,0 +1,142 @@
+#pragma once
+
+#include "GridWalk.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <utility>
+#include <vector>
+
+// Uniform grid over a set of points, hashed into a flat table so only
+// occupied space costs memory. Built in two passes (count, then scatter), so
+// the buckets are contiguous slices of one array, no per cell allocations.
+// Items are plain indices into the caller's arrays, like Broadphase. Meant
+// for many small things that rarely move; rebuild after they do.
+class SpatialHash {
+private:
+  float invCell = 1.0f;
+  uint32_t mask = 0;
+  std::vector<uint32_t> bucketStart; // mask + 2 entries, bucket b is
+  std::vector<uint32_t> items;       // items[bucketStart[b]..bucketStart[b+1])
+  // Query stamp per bucket, so a query reads each bucket once even when
+  // several of its cells share one
+  mutable std::vector<uint32_t> bucketStamp;
+  mutable uint32_t stamp = 0;
+
+  glm::ivec3 cellOf(const glm::vec3 &p) const {
+    return glm::ivec3(std::floor(p.x * invCell), std::floor(p.y * invCell),
+                      std::floor(p.z * invCell));
+  };
+
+  uint32_t bucketOf(const glm::ivec3 &c) const {
+    // Teschner et al. 2003
+    uint32_t h = (uint32_t)c.x * 73856093u ^ (uint32_t)c.y * 19349663u ^
+                 (uint32_t)c.z * 83492791u;
+    return h & mask;
+  };
+
+  void nextStamp() const {
+    if (++stamp == 0) { // wrapped, old stamps could match again
+      std::fill(bucketStamp.begin(), bucketStamp.end(), 0u);
+      stamp = 1;
+    }
+  };
+
+  // Visits the items of the buckets of cells [a, b] not yet seen this
+  // query, false once visit asks to stop
+  template <typename F>
+  bool visitCells(const glm::ivec3 &a, const glm::ivec3 &b, F &visit) const {
+    for (int z = a.z; z <= b.z; ++z) {
+      for (int y = a.y; y <= b.y; ++y) {
+        for (int x = a.x; x <= b.x; ++x) {
+          uint32_t bucket = bucketOf(glm::ivec3(x, y, z));
+          if (bucketStamp[bucket] == stamp)
+            continue;
+          bucketStamp[bucket] = stamp;
+          for (uint32_t i = bucketStart[bucket]; i < bucketStart[bucket + 1];
+               ++i) {
+            if (!visit((int)items[i]))
+              return false;
+          }
+        }
+      }
+    }
+    return true;
+  }
+
+public:
+  // cellSize should be at least the diameter of the largest query, then a
+  // query touches at most 8 cells
+  void build(const glm::vec3 *points, size_t count, float cellSize) {
+    invCell = 1.0f / cellSize;
+    uint32_t buckets = 16;
+    while (buckets < 2 * count)
+      buckets *= 2;
+    mask = buckets - 1;
+
+    bucketStart.assign(buckets + 1, 0);
+    bucketStamp.assign(buckets, 0);
+    stamp = 0;
+    for (size_t i = 0; i < count; ++i)
+      bucketStart[bucketOf(cellOf(points[i])) + 1]++;
+    for (uint32_t b = 0; b < buckets; ++b)
+      bucketStart[b + 1] += bucketStart[b];
+    items.resize(count);
+    std::vector<uint32_t> fill(bucketStart.begin(), bucketStart.end() - 1);
+    for (size_t i = 0; i < count; ++i)
+      items[fill[bucketOf(cellOf(points[i]))]++] = (uint32_t)i;
+  };
+
+  void clear() {
+    bucketStart.clear();
+    bucketStamp.clear();
+    items.clear();
+  };
+
+  // Calls visit(item) for every point in a cell the box [lo, hi] touches,
+  // the caller does the exact test. Points in other cells that share a
+  // bucket come along too, each point at most once. Returning false from
+  // visit stops the query.
+  template <typename F>
+  void query(const glm::vec3 &lo, const glm::vec3 &hi, F &&visit) const {
+    if (items.empty())
+      return;
+    nextStamp();
+    visitCells(cellOf(lo), cellOf(hi), visit);
+  }
+
+  // Same for the points within reach of the segment from -> to. The cells
+  // along the segment are walked with a 3D DDA, each with the neighbours
+  // reach pulls in, so the cost follows the segment's length rather than
+  // the volume of its bounding box.
+  template <typename F>
+  void querySegment(const glm::vec3 &from, const glm::vec3 &to, float reach,
+                    F &&visit) const {
+    if (items.empty())
+      return;
+    nextStamp();
+    float cell = 1.0f / invCell;
+    glm::ivec3 end = cellOf(to);
+    GridWalk walk(from * invCell, (to - from) * invCell, cellOf(from));
+    glm::ivec3 left = glm::abs(end - walk.cell);
+    int steps = left.x + left.y + left.z;
+    for (int i = 0; i <= steps; ++i) {
+      if (i > 0)
+        walk.next();
+      glm::vec3 lo = glm::vec3(walk.cell) * cell;
+      if (!visitCells(cellOf(lo - glm::vec3(reach)),
+                      cellOf(lo + glm::vec3(cell + reach)), visit))
+        return;
+    }
+  }
+
+  // Same for the box around a sphere
+  template <typename F>
+  void query(const glm::vec3 &center, float radius, F &&visit) const {
+    query(center - glm::vec3(radius), center + glm::vec3(radius),
+          std::forward<F>(visit));
+  }
+
+  size_t size() const { return this->items.size(); };
+};
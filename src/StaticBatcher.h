@@ -0,0 +1,173 @@
+#pragma once
+
+#include "FrameStats.h"
+#include "Frustum.h"
+#include "GLState.h"
+#include "InstanceData.h"
+#include "Program.h"
+#include "Shape.h"
+#include "Structure.h"
+#include "VaoCache.h"
+#include <cassert>
+#include <memory>
+#include <vector>
+
+// Layout of one indirect draw, as glMultiDrawElementsIndirect reads it
+struct DrawElementsIndirectCommand {
+  GLuint count;
+  GLuint instanceCount;
+  GLuint firstIndex;
+  GLint baseVertex;
+  GLuint baseInstance;
+};
+
+// Packs the static cubes of every Structure into one world instance buffer,
+// each structure owning a sub-range, and draws the whole level in one
+// glMultiDrawElementsIndirect. Without multi-draw/base instance support it
+// falls back to one instanced draw per structure, still with the one cached
+// VAO. Structures in mesh mode skip the batch and draw their
+// greedy meshed surface instead.
+class StaticBatcher {
+private:
+  // Growing a structure past its range forces a relayout, leave some room
+  static constexpr float SLACK = 0.25f;
+
+  std::shared_ptr<Shape> cubeMesh;
+  std::vector<std::shared_ptr<Structure>> structures;
+  std::vector<DrawElementsIndirectCommand> commands;
+  GLuint instanceVBO = 0;
+  GLuint indirectBuffer = 0;
+  size_t capacity = 0; // instances
+  bool useIndirect = false;
+  bool commandsDirty = true;
+  std::vector<int> meshed; // visible mesh mode structures, rebuilt per frame
+
+  void layout() {
+    size_t total = 0;
+    std::vector<size_t> base(structures.size()), room(structures.size());
+    for (size_t i = 0; i < structures.size(); ++i) {
+      size_t n = structures[i]->getCubeCount();
+      base[i] = total;
+      bool grew = structures[i]->needsBatchRelayout();
+      room[i] = grew ? n + size_t(n * SLACK) : n;
+      total += room[i];
+    }
+    capacity = total;
+
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(InstanceData), nullptr,
+                 GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    for (size_t i = 0; i < structures.size(); ++i) {
+      structures[i]->attachInstanceBuffer(instanceVBO, base[i], room[i]);
+    }
+
+    commands.assign(structures.size(), DrawElementsIndirectCommand());
+    for (size_t i = 0; i < structures.size(); ++i) {
+      commands[i].count = cubeMesh->getDrawCount();
+      commands[i].firstIndex = 0;
+      commands[i].baseVertex = 0;
+      commands[i].baseInstance = (GLuint)base[i];
+    }
+    commandsDirty = true;
+  }
+
+public:
+  StaticBatcher() = default;
+
+  // Frees the shared buffers and lets go of the structures. Called from main
+  // before the window goes, the batcher is a global that outlives the GL
+  // context.
+  void release() {
+    if (instanceVBO)
+      glDeleteBuffers(1, &instanceVBO);
+    if (indirectBuffer)
+      glDeleteBuffers(1, &indirectBuffer);
+    instanceVBO = indirectBuffer = 0;
+    structures.clear();
+  };
+
+  // Call once all structures exist, they stop owning their own buffers
+  void build(std::shared_ptr<Shape> cubeMesh,
+             const std::vector<std::shared_ptr<Structure>> &structures) {
+    assert(cubeMesh->getIndexBufID() && "batched mesh must be indexed");
+    this->cubeMesh = cubeMesh;
+    this->structures = structures;
+    useIndirect = GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance;
+    if (!instanceVBO)
+      glGenBuffers(1, &instanceVBO);
+    if (useIndirect && !indirectBuffer)
+      glGenBuffers(1, &indirectBuffer);
+    layout();
+  };
+
+  // Flush whatever the structures changed this frame and draw the cubes of
+  // every structure whose bounds touch the frustum. Culled structures just
+  // get a zero instance count in their command.
+  void draw(const std::shared_ptr<Program> &prog, const Frustum &frustum) {
+    if (structures.empty())
+      return;
+
+    bool relayout = false;
+    for (auto &s : structures) {
+      relayout = relayout || s->needsBatchRelayout();
+    }
+    if (relayout)
+      layout();
+
+    meshed.clear();
+    for (size_t i = 0; i < structures.size(); ++i) {
+      structures[i]->flushInstanceBuffer();
+      GLuint n = (GLuint)structures[i]->getCubeCount();
+      bool visible = frustum.intersects(structures[i]->getBounds());
+      if (visible && structures[i]->isMeshMode()) {
+        frameStats.current.structuresVisible++;
+        meshed.push_back((int)i);
+        n = 0;
+      } else if (visible) {
+        frameStats.current.structuresVisible++;
+        countInstances(n, n);
+      } else {
+        frameStats.current.structuresCulled++;
+        countInstances(0, n);
+        n = 0;
+      }
+      if (commands[i].instanceCount != n) {
+        commands[i].instanceCount = n;
+        commandsDirty = true;
+      }
+    }
+
+    const VaoCache::Entry &vao = vaoCache.get(
+        VertexSource::of(*cubeMesh), *prog, instanceVBO, InstanceFormat::FULL);
+    if (useIndirect) {
+      // baseInstance in each command picks the structure's sub-range
+      glState.bindVertexArray(vao.vao);
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+      if (commandsDirty) {
+        size_t bytes = commands.size() * sizeof(DrawElementsIndirectCommand);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, bytes, commands.data(),
+                     GL_DYNAMIC_DRAW);
+        countUpload(bytes);
+        commandsDirty = false;
+      }
+      glMultiDrawElementsIndirect(GL_TRIANGLES, vao.indexType, (void *)0,
+                                  (GLsizei)commands.size(), 0);
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    } else {
+      for (auto &cmd : commands) {
+        if (cmd.instanceCount == 0)
+          continue;
+        VaoCache::drawInstanced(vao, cmd.count, cmd.instanceCount,
+                                cmd.baseInstance);
+      }
+    }
+
+    for (int i : meshed) {
+      structures[i]->renderMesh(prog, frustum);
+    }
+  };
+
+  size_t getCapacity() const { return this->capacity; };
+  bool isIndirect() const { return this->useIndirect; };
+};
@@ -1,45 +1,328 @@
 #pragma once
 
+#include "AABB.h"
+#include "CubeKernels.h"
+#include "DebrisField.h"
 #include "Eigen/src/Core/Matrix.h"
+#include "FrameStats.h"
+#include "DynamicRing.h"
+#include "Frustum.h"
 #include "GLM_EIGEN_COMPATIBILITY_LAYER.h"
+#include "GLState.h"
+#include "GreedyMesher.h"
+#include "GridWalk.h"
+#include "InstanceData.h"
+#include "Lattice.h"
+#include "Narrowphase.h"
 #include "Program.h"
+#include "RubbleBuffer.h"
 #include "Shape.h"
+#include "Span.h"
+#include "Sweep.h"
+#include "VaoCache.h"
+#include <algorithm>
 #include <cassert>
-struct FreeCube {
-  Eigen::Vector3d position;
-  Eigen::Vector3d velocity;
-  float size;
+#include <cstddef>
+#include <cfloat>
+#include <cstdint>
+
+// Stable reference to one static cube. Stays valid while other cubes are
+// removed; goes stale (generation mismatch) once its own cube is removed.
+struct CubeHandle {
+  uint32_t slot = UINT32_MAX;
+  uint32_t generation = 0;
+
+  bool operator==(const CubeHandle &o) const {
+    return slot == o.slot && generation == o.generation;
+  };
+  bool operator!=(const CubeHandle &o) const { return !(*this == o); };
+};
+
+// Pool entry behind a CubeHandle. Particles are indexed by slot as well.
+struct CubeSlot {
+  static constexpr int MAX_SPRINGS = 6; // one per lattice neighbour
+
+  uint32_t generation = 0;
+  int dense = -1; // index into the draw list, -1 while free
+  int cell = -1;  // lattice cell, -1 if not on a lattice
+  int springs[MAX_SPRINGS];
+  int springCount = 0;
+};
+
+// Half open range of draw list indices waiting to be uploaded
+struct DirtyRange {
+  size_t first;
+  size_t end;
+};
+
+// Block of lattice cells meshed together, remeshed as a unit when one of
+// its cells changes
+struct MeshChunk {
+  glm::ivec3 lo, hi; // cell range [lo, hi)
+  GLuint vbo = 0;
+  GLsizei vertexCount = 0;
+  bool dirty = true;
+};
+
+// Cubes touched by one query, see collisionSphere
+using CubeHits = FixedHits<CubeHandle, 32>;
+
+// First cube a moving sphere runs into, see sweepSphere. t is the fraction
+// of the move at contact, 1 while nothing was hit.
+struct SweepHit {
+  float t = 1.0f;
+  CubeHandle cube;
+  glm::vec3 point = glm::vec3(0.0f);  // sphere center at contact
+  glm::vec3 normal = glm::vec3(0.0f); // out of the cube, at the contact
+
+  bool hit() const { return cube.slot != UINT32_MAX; };
+};
+
+// First cube along a ray, see raycast. t is a distance along the ray, set it
+// to the longest distance of interest before the query.
+struct RayHit {
+  float t = FLT_MAX;
+  CubeHandle cube;
+  glm::vec3 normal = glm::vec3(0.0f); // world normal of the face entered
+
+  bool hit() const { return cube.slot != UINT32_MAX; };
 };
 
 class Structure {
 private:
   std::shared_ptr<Shape> cubeMesh;
+  // Cube pool: modelMatsStatic is the dense draw list (kept packed with
+  // swap-remove), denseSlot maps it back to the stable slots
   std::vector<glm::mat4> modelMatsStatic;
-  std::vector<FreeCube> freeCubes; // Cubes that are now fractured
-  GLuint instanceVBO;              // buffer for instance mats
-  GLuint debrisVBO = 0;
+  std::vector<uint32_t> denseSlot;
+  // The cube centers again as SoA, parallel to modelMatsStatic, so the
+  // collision kernels read 12 bytes a cube instead of a 64 byte matrix
+  std::vector<float> centerX, centerY, centerZ;
+  std::vector<CubeSlot> slots;
+  std::vector<uint32_t> freeSlots;
+  DebrisField debris;                // Cubes that are now fractured
+  std::vector<glm::vec4> debrisInstances; // their posScale, reused per frame
+  GLuint instanceVBO; // buffer for the packed InstanceData of our cubes
+  // Once a StaticBatcher takes over, instanceVBO is its shared world buffer
+  // and our instances live at [instanceBase, instanceBase + gpuCapacity)
+  bool sharedInstanceVBO = false;
+  size_t instanceBase = 0;
+  // Instance upload bookkeeping, only what changed since the last flush goes
+  // to the GPU. gpuCapacity is how many cubes we have room for in
+  // instanceVBO. The mats are packed into instanceScratch on the way up.
+  static constexpr int MAX_DIRTY_RANGES = 8;
+  std::vector<DirtyRange> dirtyRanges;
+  std::vector<InstanceData> instanceScratch;
+  size_t gpuCapacity = 0;
   // AKA origin of structure
   glm::vec3 center;
-  std::vector<std::shared_ptr<Particle>> particles;
+  std::vector<std::shared_ptr<Particle>> particles; // by slot
   std::vector<std::shared_ptr<Spring>> springs;
+  std::vector<std::pair<uint32_t, uint32_t>> springSlots; // spring -> slots
   bool fracturable = true;
 
   // For transforms
   glm::mat4 worldXform = glm::mat4(1.0f);
 
+  // Lattice the cubes live on, lets queries skip straight to nearby cells
+  Lattice lattice;
+  // Inverse of lattice.rotation, which is just the transpose since the cubes
+  // are rigid. Kept in step with the lattice so queries never invert
+  glm::mat3 latticeRotT = glm::mat3(1.0f);
+
+  void setCenter(size_t k) {
+    centerX[k] = modelMatsStatic[k][3].x;
+    centerY[k] = modelMatsStatic[k][3].y;
+    centerZ[k] = modelMatsStatic[k][3].z;
+  };
+
+  // Rotation of cube k and its inverse. Lattice cubes all share the
+  // structure's, anything else is read off its (rigid) model matrix
+  void cubeFrame(int k, glm::mat3 &R, glm::mat3 &Rt) const {
+    if (lattice.valid()) {
+      R = lattice.rotation;
+      Rt = latticeRotT;
+    } else {
+      R = glm::mat3(modelMatsStatic[k]);
+      Rt = glm::transpose(R);
+    }
+  };
+
+  // Mesh mode: the static cubes are drawn as a greedy merged surface built
+  // from the lattice instead of one instanced cube each
+  static constexpr int CHUNK_SIZE = 16;
+  bool meshMode = false;
+  glm::ivec3 chunkDims = glm::ivec3(0);
+  std::vector<MeshChunk> meshChunks;
+  std::vector<MeshVertex> meshScratch;
+
+  static VertexSource chunkSource(const MeshChunk &chunk) {
+    VertexSource v;
+    v.pos.buf = v.nor.buf = chunk.vbo;
+    v.pos.stride = v.nor.stride = sizeof(MeshVertex);
+    v.pos.offset = offsetof(MeshVertex, pos);
+    v.nor.offset = offsetof(MeshVertex, nor);
+    return v;
+  }
+
+  void buildMeshChunks() {
+    for (auto &chunk : meshChunks) {
+      if (chunk.vbo) {
+        vaoCache.forget(chunk.vbo);
+        glDeleteBuffers(1, &chunk.vbo);
+      }
+    }
+    meshChunks.clear();
+    chunkDims = (lattice.dims + glm::ivec3(CHUNK_SIZE - 1)) / CHUNK_SIZE;
+    for (int k = 0; k < chunkDims.z; ++k) {
+      for (int j = 0; j < chunkDims.y; ++j) {
+        for (int i = 0; i < chunkDims.x; ++i) {
+          MeshChunk chunk;
+          chunk.lo = glm::ivec3(i, j, k) * CHUNK_SIZE;
+          chunk.hi = glm::min(chunk.lo + glm::ivec3(CHUNK_SIZE), lattice.dims);
+          glGenBuffers(1, &chunk.vbo);
+          meshChunks.push_back(chunk);
+        }
+      }
+    }
+  }
+
+  // A cell changed: remesh its chunk, plus the neighbouring chunk when the
+  // cell sits on a chunk border (the neighbour's face against it flips)
+  void markCellDirty(int cell) {
+    if (meshChunks.empty())
+      return;
+    glm::ivec3 c = lattice.cellCoords(cell);
+    glm::ivec3 chunk = c / CHUNK_SIZE;
+    auto mark = [&](glm::ivec3 ch) {
+      if (ch.x < 0 || ch.y < 0 || ch.z < 0 || ch.x >= chunkDims.x ||
+          ch.y >= chunkDims.y || ch.z >= chunkDims.z)
+        return;
+      meshChunks[(ch.z * chunkDims.y + ch.y) * chunkDims.x + ch.x].dirty = true;
+    };
+    mark(chunk);
+    for (int a = 0; a < 3; ++a) {
+      glm::ivec3 step(0);
+      step[a] = 1;
+      if (c[a] % CHUNK_SIZE == 0)
+        mark(chunk - step);
+      if (c[a] % CHUNK_SIZE == CHUNK_SIZE - 1)
+        mark(chunk + step);
+    }
+  }
+
+  void remeshDirtyChunks() {
+    for (auto &chunk : meshChunks) {
+      if (!chunk.dirty)
+        continue;
+      meshScratch.clear();
+      greedyMeshRegion(lattice, chunk.lo, chunk.hi, meshScratch);
+      glBindBuffer(GL_ARRAY_BUFFER, chunk.vbo);
+      glBufferData(GL_ARRAY_BUFFER, meshScratch.size() * sizeof(MeshVertex),
+                   meshScratch.data(), GL_STATIC_DRAW);
+      countUpload(meshScratch.size() * sizeof(MeshVertex));
+      chunk.vertexCount = (GLsizei)meshScratch.size();
+      chunk.dirty = false;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+
+  // Lattice space (cell units) to world
+  glm::mat4 latticeTransform() const {
+    glm::mat4 M(lattice.rotation);
+    M[3] = glm::vec4(lattice.origin, 1.0f);
+    return M;
+  }
+
+  // World bounds of the static cubes, rebuilt lazily after any change
+  AABB bounds;
+  bool boundsDirty = true;
+
+  void recomputeBounds() {
+    bounds = AABB();
+    for (auto &M : modelMatsStatic) {
+      // Half extents of a (possibly rotated) unit cube along each world axis
+      glm::vec3 ext;
+      for (int i = 0; i < 3; ++i) {
+        ext[i] = 0.5f * (fabs(M[0][i]) + fabs(M[1][i]) + fabs(M[2][i]));
+      }
+      glm::vec3 c = glm::vec3(M[3]);
+      bounds.expand(AABB(c - ext, c + ext));
+    }
+    boundsDirty = false;
+  }
+
+  void detachSpring(uint32_t slot, int spring) {
+    CubeSlot &cs = slots[slot];
+    for (int i = 0; i < cs.springCount; ++i) {
+      if (cs.springs[i] == spring) {
+        cs.springs[i] = cs.springs[--cs.springCount];
+        return;
+      }
+    }
+  }
+
+  void renumberSpring(uint32_t slot, int from, int to) {
+    CubeSlot &cs = slots[slot];
+    for (int i = 0; i < cs.springCount; ++i) {
+      if (cs.springs[i] == from)
+        cs.springs[i] = to;
+    }
+  }
+
+  // Swap-remove, only the springs that moved get renumbered
+  void removeSpring(int s) {
+    detachSpring(springSlots[s].first, s);
+    detachSpring(springSlots[s].second, s);
+    int last = (int)springs.size() - 1;
+    if (s != last) {
+      springs[s] = springs[last];
+      springSlots[s] = springSlots[last];
+      renumberSpring(springSlots[s].first, last, s);
+      renumberSpring(springSlots[s].second, last, s);
+    }
+    springs.pop_back();
+    springSlots.pop_back();
+  }
+
+  void markDirty(size_t first, size_t count) {
+    size_t end = first + count;
+    for (auto &r : dirtyRanges) {
+      if (first <= r.end && end >= r.first) {
+        r.first = std::min(r.first, first);
+        r.end = std::max(r.end, end);
+        return;
+      }
+    }
+    if ((int)dirtyRanges.size() < MAX_DIRTY_RANGES) {
+      dirtyRanges.push_back({first, end});
+      return;
+    }
+    // too fragmented, one covering range is cheaper than many small uploads
+    DirtyRange all{first, end};
+    for (auto &r : dirtyRanges) {
+      all.first = std::min(all.first, r.first);
+      all.end = std::max(all.end, r.end);
+    }
+    dirtyRanges.assign(1, all);
+  }
+
 public:
   Structure(std::shared_ptr<Shape> cubeMesh) : cubeMesh(cubeMesh) {
     // Ensure shape passed is indeed a cube, if not reject
     assert(cubeMesh->getType() == ShapeType::CUBE);
     // If is cube, generate instanceVBO
     glGenBuffers(1, &instanceVBO);
-    glGenBuffers(1, &debrisVBO);
   };
+  // Structures only die at the end of main, right before vaoCache drops
+  // every VAO, so our buffers aren't forget()-ten here
   ~Structure() {
-    if (instanceVBO)
+    if (instanceVBO && !sharedInstanceVBO)
       glDeleteBuffers(1, &instanceVBO);
-    if (debrisVBO)
-      glDeleteBuffers(1, &debrisVBO);
+    for (auto &chunk : meshChunks) {
+      if (chunk.vbo)
+        glDeleteBuffers(1, &chunk.vbo);
+    }
   }
 
   virtual void createStructure(std::shared_ptr<Shape> cubeMesh, int width,
@@ -49,21 +332,17 @@ public:
   void rotate(float angle, const glm::vec3 &axis) {
     glm::mat4 R = glm::rotate(glm::mat4(1.0f), angle, axis);
 
-    // 1) rotate all the instance matrices
-    for (auto &M : modelMatsStatic) {
-      M = R * M;
+    // 1) rotate all the instance matrices, and the lattice they sit on
+    for (size_t k = 0; k < modelMatsStatic.size(); ++k) {
+      modelMatsStatic[k] = R * modelMatsStatic[k];
+      setCenter(k);
     }
+    lattice.origin = glm::vec3(R * glm::vec4(lattice.origin, 1.0f));
+    lattice.rotation = glm::mat3(R) * lattice.rotation;
+    latticeRotT = glm::transpose(lattice.rotation);
 
     // 2) rotate any “free” cubes
-    for (auto &fc : freeCubes) {
-      glm::vec4 p(fc.position.x(), fc.position.y(), fc.position.z(), 1.0f);
-      p = R * p;
-      fc.position = glmVec3ToEigen(glm::vec3(p));
-
-      glm::vec4 v(fc.velocity.x(), fc.velocity.y(), fc.velocity.z(), 0.0f);
-      v = R * v;
-      fc.velocity = glmVec3ToEigen(glm::vec3(v));
-    }
+    debris.transform(R);
 
     // 3) rotate your constraint‐solver particles too
     for (auto &p : particles) {
@@ -76,255 +355,406 @@ public:
       p->v = glmVec3ToEigen(glm::vec3(vel));
     }
 
-    // 4) re‐upload your instance VBO to reflect the new modelMatsStatic
-    uploadInstanceBuffer();
+    // 4) every instance moved, flushed on the next render
+    markDirty(0, modelMatsStatic.size());
+    boundsDirty = true;
   };
 
+  // idx is a draw list index
   void setModelMatAtIdx(int idx, glm::mat4 &M) {
     this->modelMatsStatic[idx] = M;
+    setCenter(idx);
+    markDirty(idx, 1);
+    boundsDirty = true;
+    // An arbitrary matrix no longer sits on the lattice, fall back to scans
+    lattice.dims = glm::ivec3(0);
+  };
+  // Views into the live cube data, no copies
+  Span<const glm::mat4> getModelMatsStatic() const {
+    return Span<const glm::mat4>(modelMatsStatic.data(), modelMatsStatic.size());
   };
-  std::vector<glm::mat4> getModelMatsStatic() { return this->modelMatsStatic; };
+  const glm::mat4 &getModelMat(int k) const { return modelMatsStatic[k]; };
+  const glm::mat4 &getModelMat(CubeHandle h) const {
+    assert(isAlive(h));
+    return modelMatsStatic[slots[h.slot].dense];
+  };
+
+  // HANDLES
+  bool isAlive(CubeHandle h) const {
+    return h.slot < slots.size() && slots[h.slot].generation == h.generation &&
+           slots[h.slot].dense >= 0;
+  };
+  // Handle of the cube currently at draw list index k
+  CubeHandle handleAt(int k) const {
+    uint32_t slot = denseSlot[k];
+    return CubeHandle{slot, slots[slot].generation};
+  };
+  size_t getCubeCount() const { return this->modelMatsStatic.size(); };
   std::shared_ptr<Shape> getMesh() { return this->cubeMesh; };
 
-  std::vector<FreeCube> &getFreeCubes() { return this->freeCubes; };
+  // Broadphase refits whenever this reports true
+  bool isBoundsDirty() const { return this->boundsDirty; };
+  const AABB &getBounds() {
+    if (boundsDirty)
+      recomputeBounds();
+    return this->bounds;
+  };
+
+  const DebrisField &getDebris() const { return this->debris; };
 
   bool getFracturable() { return this->fracturable; };
   void setFracturable(bool isFrac) { this->fracturable = isFrac; };
 
-  std::vector<std::shared_ptr<Particle>> getParticleArray() {
+  const std::vector<std::shared_ptr<Particle>> &getParticleArray() const {
     return this->particles;
   };
 
-  std::vector<std::shared_ptr<Spring>> getSpringsArray() {
+  const std::vector<std::shared_ptr<Spring>> &getSpringsArray() const {
     return this->springs;
   };
 
-  void pushToParticles(std::shared_ptr<Particle> p) {
-    this->particles.push_back(p);
+  void setParticle(CubeHandle h, std::shared_ptr<Particle> p) {
+    assert(isAlive(h));
+    if (particles.size() <= h.slot)
+      particles.resize(h.slot + 1);
+    this->particles[h.slot] = p;
+  };
+
+  // Spring between the particles of two cube slots
+  void connectSlots(uint32_t slot0, uint32_t slot1, double alpha) {
+    CubeSlot &a = slots[slot0];
+    CubeSlot &b = slots[slot1];
+    assert(a.springCount < CubeSlot::MAX_SPRINGS &&
+           b.springCount < CubeSlot::MAX_SPRINGS);
+    int s = (int)springs.size();
+    springs.push_back(
+        std::make_shared<Spring>(particles[slot0], particles[slot1], alpha));
+    springSlots.push_back({slot0, slot1});
+    a.springs[a.springCount++] = s;
+    b.springs[b.springCount++] = s;
   };
-  void pushToSprings(std::shared_ptr<Spring> s) { this->springs.push_back(s); };
 
-  std::shared_ptr<Particle> getParticleAtIdx(int idx) {
-    return this->particles.at(idx);
+  // Slots are handed out in push order while the pool has no holes, so
+  // createStructure can address its particles by grid index
+  std::shared_ptr<Particle> getParticleAtIdx(int slot) {
+    return this->particles.at(slot);
   }
 
-  // Once done filling modeMatsStatic, upload to instace buffer, and everytime
-  // structure changes
-  void uploadInstanceBuffer() {
+  // Rewrite cubes [first, first + count) of the instance buffer in place
+  void uploadInstanceRange(size_t first, size_t count) {
+    if (count == 0)
+      return;
+    instanceScratch.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+      instanceScratch[i] = packInstance(modelMatsStatic[first + i]);
+    }
     glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
-    glBufferData(GL_ARRAY_BUFFER, modelMatsStatic.size() * sizeof(glm::mat4),
-                 modelMatsStatic.data(), GL_DYNAMIC_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER,
+                    (instanceBase + first) * sizeof(InstanceData),
+                    count * sizeof(InstanceData), instanceScratch.data());
     glBindBuffer(GL_ARRAY_BUFFER, 0);
+    countUpload(count * sizeof(InstanceData));
   }
 
-  void updateDebris(float dt) {
-    for (auto &d : freeCubes) {
-      // unpack
-      glm::vec3 vel{(float)d.velocity.x(), (float)d.velocity.y(),
-                    (float)d.velocity.z()};
-      glm::vec3 pos{(float)d.position.x(), (float)d.position.y(),
-                    (float)d.position.z()};
-
-      // gravity + air drag
-      float dragCoefficient = 0.9f;
-      vel += glm::vec3(0.0f, -30.8f, 0.0f) * dt;
-      vel *= 1.0f - dragCoefficient * dt;
-      pos += vel * dt;
-
-      // simple ground bounce
-      if (pos.y < 0.0f) {
-        pos.y = 0.0f;
-        vel.y *= -0.4f;
+  // Once done filling modeMatsStatic, (re)allocate the instance buffer with
+  // everything in it. Later changes go through markDirty/flushInstanceBuffer.
+  void uploadInstanceBuffer() {
+    if (sharedInstanceVBO) {
+      // can't reallocate the shared buffer, outgrowing it is the batcher's
+      // problem (see needsBatchRelayout)
+      if (modelMatsStatic.size() <= gpuCapacity) {
+        uploadInstanceRange(0, modelMatsStatic.size());
+        dirtyRanges.clear();
       }
+      return;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER,
+                 modelMatsStatic.size() * sizeof(InstanceData), nullptr,
+                 GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    gpuCapacity = modelMatsStatic.size();
+    uploadInstanceRange(0, modelMatsStatic.size());
+    dirtyRanges.clear();
+  }
+
+  bool isInstanceDirty() const { return !dirtyRanges.empty(); };
+  bool needsBatchRelayout() const {
+    return sharedInstanceVBO && modelMatsStatic.size() > gpuCapacity;
+  };
 
-      // pack back
-      d.velocity = Eigen::Vector3d(vel.x, vel.y, vel.z);
-      d.position = Eigen::Vector3d(pos.x, pos.y, pos.z);
+  // Move our instances into [base, base + capacity) of a shared buffer owned
+  // by the StaticBatcher, the private buffer is freed
+  void attachInstanceBuffer(GLuint vbo, size_t base, size_t capacity) {
+    if (instanceVBO && !sharedInstanceVBO) {
+      vaoCache.forget(instanceVBO);
+      glDeleteBuffers(1, &instanceVBO);
     }
+    instanceVBO = vbo;
+    sharedInstanceVBO = true;
+    instanceBase = base;
+    gpuCapacity = capacity;
+    uploadInstanceBuffer();
+  };
+
+  // Upload the dirty ranges, no-op for the (usual) untouched structure
+  void flushInstanceBuffer() {
+    if (modelMatsStatic.size() > gpuCapacity) {
+      uploadInstanceBuffer();
+      return;
+    }
+    for (auto &r : dirtyRanges) {
+      // the draw list may have shrunk since the range was marked
+      size_t end = std::min(r.end, modelMatsStatic.size());
+      if (r.first < end)
+        uploadInstanceRange(r.first, end - r.first);
+    }
+    dirtyRanges.clear();
   }
 
-  void renderDebris(const std::shared_ptr<Program> &prog) {
-    if (freeCubes.empty())
+  // Steps the live debris, cubes that came to rest move into the rubble
+  void updateDebris(float dt, RubbleBuffer &rubble) {
+    debris.integrate(dt);
+    debris.collectSleepers(
+        [&](const glm::vec3 &pos, float s) { rubble.bake(pos, s); });
+  }
+
+  void renderDebris(const std::shared_ptr<Program> &prog,
+                    const Frustum &frustum) {
+    if (debris.empty())
       return;
 
-    // 1) build a temporary array of glm::mat4's from your FreeCube data:
-    std::vector<glm::mat4> debrisMats;
-    debrisMats.reserve(freeCubes.size());
-    for (auto &fc : freeCubes) {
-      glm::mat4 M = glm::translate(glm::mat4(1.0f),
-                                   glm::vec3(fc.position.x(), fc.position.y(),
-                                             fc.position.z())) *
-                    glm::scale(glm::mat4(1.0f), glm::vec3(fc.size));
-      debrisMats.push_back(M);
-    }
-
-    // 2) bind your cube VAO and per‐vertex attribs exactly like
-    // renderStructure:
-    glBindVertexArray(cubeMesh->getVAO());
-    int posLoc = prog->getAttribute("aPos");
-    glEnableVertexAttribArray(posLoc);
-    glBindBuffer(GL_ARRAY_BUFFER, cubeMesh->getPosBufID());
-    glVertexAttribPointer(posLoc, 3, GL_FLOAT, GL_FALSE, 0, (void *)0);
-
-    int norLoc = prog->getAttribute("aNor");
-    if (norLoc >= 0) {
-      glEnableVertexAttribArray(norLoc);
-      glBindBuffer(GL_ARRAY_BUFFER, cubeMesh->getNorBufID());
-      glVertexAttribPointer(norLoc, 3, GL_FLOAT, GL_FALSE, 0, (void *)0);
-    }
-
-    int texLoc = prog->getAttribute("aTex");
-    if (texLoc >= 0 && cubeMesh->getTexBufID() != 0) {
-      glEnableVertexAttribArray(texLoc);
-      glBindBuffer(GL_ARRAY_BUFFER, cubeMesh->getTexBufID());
-      glVertexAttribPointer(texLoc, 2, GL_FLOAT, GL_FALSE, 0, (void *)0);
-    }
-
-    // 3) upload debrisMats into debrisVBO
-    glBindBuffer(GL_ARRAY_BUFFER, debrisVBO);
-    glBufferData(GL_ARRAY_BUFFER, debrisMats.size() * sizeof(glm::mat4),
-                 debrisMats.data(), GL_DYNAMIC_DRAW);
-
-    // 4) hook it to aInstMat0..3 with divisor=1:
-    std::size_t vec4Size = sizeof(glm::vec4);
-    int matLoc[4] = {
-        prog->getAttribute("aInstMat0"), prog->getAttribute("aInstMat1"),
-        prog->getAttribute("aInstMat2"), prog->getAttribute("aInstMat3")};
-    for (int i = 0; i < 4; ++i) {
-      if (matLoc[i] < 0)
-        continue;
-      glEnableVertexAttribArray(matLoc[i]);
-      glVertexAttribPointer(matLoc[i], 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
-                            (void *)(i * vec4Size));
-      glVertexAttribDivisor(matLoc[i], 1);
-    }
-
-    // 5) finally draw instanced
-    GLsizei instanceCount = (GLsizei)debrisMats.size();
-    glDrawArraysInstanced(GL_TRIANGLES, 0, cubeMesh->getVertexCount(),
-                          instanceCount);
-
-    // 6) cleanup
-    for (int i = 0; i < 4; ++i) {
-      if (matLoc[i] >= 0) {
-        glDisableVertexAttribArray(matLoc[i]);
-        glVertexAttribDivisor(matLoc[i], 0);
-      }
-    }
-    if (texLoc >= 0)
-      glDisableVertexAttribArray(texLoc);
-    glDisableVertexAttribArray(posLoc);
-    if (norLoc >= 0)
-      glDisableVertexAttribArray(norLoc);
+    // 1) instance posScale straight from the debris arrays
+    debrisInstances.resize(debris.getCount());
+    debris.writeInstances(debrisInstances.data());
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    // keep only what the camera can see (a unit cube fits in r = sqrt(3)/2),
+    // written straight into this frame's part of the dynamic ring
+    size_t total = debrisInstances.size();
+    DynamicRing::Alloc ring = dynamicRing.alloc(total * sizeof(glm::vec4));
+    if (!ring)
+      return;
+    size_t visible = frustum.compactVisible(debrisInstances.data(), total,
+                                            0.87f, (glm::vec4 *)ring.ptr);
+    countInstances(visible, total);
+    if (visible == 0)
+      return;
+
+    // 2) the visible instances are in the ring already
+    dynamicRing.commit(ring, visible * sizeof(glm::vec4));
+
+    // 3) cube VAO reading posScale from the ring, debris isn't rotated. The
+    // ring offset is 16 byte aligned so it is a whole record index.
+    const VaoCache::Entry &vao =
+        vaoCache.get(VertexSource::of(*cubeMesh), *prog,
+                     dynamicRing.getBuffer(), InstanceFormat::POS_SCALE);
+    VaoCache::drawInstanced(vao, cubeMesh->getDrawCount(), (GLsizei)visible,
+                            (GLuint)(ring.offset / sizeof(glm::vec4)));
   }
 
-  void renderStructure(const std::shared_ptr<Program> prog) {
-    glBindVertexArray(cubeMesh->getVAO());
-
-    // Bind vetex attribs (aPos and aNor)
-    // aPos
-    int posLoc = prog->getAttribute("aPos");
-    glEnableVertexAttribArray(posLoc);
-    glBindBuffer(GL_ARRAY_BUFFER, cubeMesh->getPosBufID());
-    glVertexAttribPointer(posLoc, 3, GL_FLOAT, GL_FALSE, 0, (void *)0);
-    // aNor
-    int norLoc = prog->getAttribute("aNor");
-    if (norLoc != -1) {
-      glEnableVertexAttribArray(norLoc);
-      glBindBuffer(GL_ARRAY_BUFFER, cubeMesh->getNorBufID());
-      glVertexAttribPointer(norLoc, 3, GL_FLOAT, GL_FALSE, 0, (void *)0);
-    }
-    // aTex
-    int texLoc = prog->getAttribute("aTex");
-    if (texLoc >= 0 && cubeMesh->getTexBufID() != 0) {
-      glEnableVertexAttribArray(texLoc);
-      glBindBuffer(GL_ARRAY_BUFFER, cubeMesh->getTexBufID());
-      glVertexAttribPointer(texLoc, 2, GL_FLOAT, GL_FALSE, 0, (void *)0);
-    }
-
-    // Bind and re-upload instance data (if it’s changed)
-    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
-    glBufferSubData(GL_ARRAY_BUFFER, 0,
-                    modelMatsStatic.size() * sizeof(glm::mat4),
-                    modelMatsStatic.data());
-
-    // Tell OpenGL how to interpret that buffer as 4 vec4 attributes:
-    //    suppose you reserve locations 4,5,6,7 for your mat4
-    std::size_t vec4Size = sizeof(glm::vec4);
-    int matLoc[4];
-    matLoc[0] = prog->getAttribute("aInstMat0");
-    matLoc[1] = prog->getAttribute("aInstMat1");
-    matLoc[2] = prog->getAttribute("aInstMat2");
-    matLoc[3] = prog->getAttribute("aInstMat3");
-    for (int i = 0; i < 4; ++i) {
-      if (matLoc[i] < 0)
-        continue; // attribute wasn’t actually active
-      glEnableVertexAttribArray(matLoc[i]);
-      glVertexAttribPointer(matLoc[i], // use the real location
-                            4, GL_FLOAT, GL_FALSE,
-                            sizeof(glm::mat4),     // 64-byte stride
-                            (void *)(i * vec4Size) // offset 0,16,32,48 bytes
-      );
-      glVertexAttribDivisor(matLoc[i], 1);
-    }
-
-    // Finally draw instanced
-    GLsizei instanceCount = (GLsizei)modelMatsStatic.size();
-    glDrawArraysInstanced(GL_TRIANGLES, 0, cubeMesh->getVertexCount(),
-                          instanceCount);
-
-    // Cleanup
-    for (int i = 0; i < 4; ++i) {
-      if (matLoc[i] >= 0) {
-        glDisableVertexAttribArray(matLoc[i]);
+  // MESH MODE
+  // Only lattice structures can be meshed, the rest keep drawing instanced
+  void setMeshMode(bool on) {
+    meshMode = on && lattice.valid();
+    if (meshMode && meshChunks.empty())
+      buildMeshChunks();
+  };
+  bool isMeshMode() const { return meshMode && lattice.valid(); };
+
+  // Draws the meshed surface, chunk by chunk. The shader still builds its
+  // transform from aInstPosScale/aInstRot; with the arrays off those read the
+  // constant values set here, i.e. the lattice transform.
+  void renderMesh(const std::shared_ptr<Program> &prog,
+                  const Frustum &frustum) {
+    remeshDirtyChunks();
+    glm::mat4 L = latticeTransform();
+
+    const InstanceAttribs *inst = nullptr;
+    for (auto &chunk : meshChunks) {
+      if (chunk.vertexCount == 0)
+        continue;
+      // chunk box in lattice space, out to world like recomputeBounds does
+      glm::vec3 c = 0.5f * glm::vec3(chunk.lo + chunk.hi) - glm::vec3(0.5f);
+      glm::vec3 e = 0.5f * glm::vec3(chunk.hi - chunk.lo);
+      glm::vec3 wc = glm::vec3(L * glm::vec4(c, 1.0f));
+      glm::vec3 we;
+      for (int i = 0; i < 3; ++i) {
+        we[i] = fabs(L[0][i]) * e.x + fabs(L[1][i]) * e.y + fabs(L[2][i]) * e.z;
       }
-      if (texLoc >= 0) {
-        glDisableVertexAttribArray(texLoc);
+      if (!frustum.intersects(AABB(wc - we, wc + we)))
+        continue;
+
+      const VaoCache::Entry &vao = vaoCache.get(chunkSource(chunk), *prog);
+      if (!inst) {
+        inst = &vao.inst;
+        inst->setConstant(glm::vec4(lattice.origin, 1.0f),
+                          quatFromRotation(lattice.rotation));
       }
+      glState.bindVertexArray(vao.vao);
+      glDrawArrays(GL_TRIANGLES, 0, chunk.vertexCount);
     }
-    glDisableVertexAttribArray(posLoc);
-    if (norLoc >= 0) {
-      glDisableVertexAttribArray(norLoc);
-    }
+    if (inst)
+      inst->resetConstant();
+  };
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+  void renderStructure(const std::shared_ptr<Program> prog) {
+    // Upload only the instance data that changed
+    flushInstanceBuffer();
+
+    // Our InstanceData range starts instanceBase records in
+    const VaoCache::Entry &vao = vaoCache.get(
+        VertexSource::of(*cubeMesh), *prog, instanceVBO, InstanceFormat::FULL);
+    VaoCache::drawInstanced(vao, cubeMesh->getDrawCount(),
+                            (GLsizei)modelMatsStatic.size(),
+                            (GLuint)instanceBase);
   };
 
-  std::vector<int> collisionSphere(const glm::vec3 &center, float radius) {
-    std::vector<int> hits;
-    for (size_t k = 0; k < modelMatsStatic.size(); ++k) {
-      glm::vec3 cubePos = glm::vec3(modelMatsStatic[k][3]);
-      float halfSize = 0.5f; // or whatever your cube’s “radius” is
-      if (glm::length(center - cubePos) < (radius + halfSize)) {
-        hits.push_back((int)k);
+  // Calls fn(k, contact) with the draw list index of every cube the sphere
+  // overlaps and the world space contact (exact sphere vs cube test)
+  template <typename F>
+  void forEachSphereHit(const glm::vec3 &center, float radius, F &&fn) const {
+    const float halfSize = 0.5f;
+    // a cube center can be up to a half diagonal from the touching point
+    float reach = radius + halfSize * 1.7321f;
+    forEachCubeCenterInSphere(
+        center, reach, [&](int k, const glm::vec3 &cubePos) {
+          glm::mat3 R, Rt;
+          cubeFrame(k, R, Rt);
+          glm::vec3 p = Rt * (center - cubePos);
+          Contact c;
+          if (sphereBox(p, radius, halfSize, c)) {
+            c.normal = R * c.normal;
+            fn(k, c);
+          }
+        });
+  }
+
+  // Fills hits with handles to the overlapped cubes
+  int collisionSphere(const glm::vec3 &center, float radius,
+                      CubeHits &hits) const {
+    hits.clear();
+    forEachSphereHit(center, radius,
+                     [&](int k, const Contact &) { hits.push(handleAt(k)); });
+    return hits.size();
+  };
+
+  // Earliest cube the sphere hits moving from -> to, with the same exact
+  // cube test as forEachSphereHit. Only hits before hit.t replace it, so one
+  // SweepHit can be passed through every structure to find the first
+  // contact overall.
+  bool sweepSphere(const glm::vec3 &from, const glm::vec3 &to, float radius,
+                   SweepHit &hit) const {
+    const float halfSize = 0.5f;
+    glm::vec3 move = to - from;
+    bool found = false;
+    AABB reach = sweptBounds(from, to, radius + halfSize * 1.7321f);
+    forEachCubeCenterInBox(reach, [&](int k, const glm::vec3 &c) {
+      glm::mat3 R, Rt;
+      cubeFrame(k, R, Rt);
+      glm::vec3 o = Rt * (from - c);
+      glm::vec3 n;
+      if (sweepSphereBox(o, Rt * move, halfSize, radius, hit.t, n)) {
+        hit.cube = handleAt(k);
+        hit.normal = R * n;
+        found = true;
       }
+    });
+    if (found)
+      hit.point = from + move * hit.t;
+    return found;
+  };
+
+  // First cube the ray origin + dir * t (dir unit length) enters before
+  // hit.t. Lattice structures walk the occupied cells with a 3D DDA
+  // (Amanatides & Woo), so the cost grows with the cells crossed, not the
+  // cube count; the rest test every cube under the segment.
+  bool raycast(const glm::vec3 &origin, const glm::vec3 &dir,
+               RayHit &hit) const {
+    if (!lattice.valid())
+      return raycastCubes(origin, dir, hit);
+
+    // Ray into lattice space, cell (i, j, k) spans (i, j, k) +- 0.5
+    glm::vec3 o = latticeRotT * (origin - lattice.origin);
+    glm::vec3 d = latticeRotT * dir;
+    float t = 0.0f, tExit = hit.t;
+    int axis;
+    if (!rayBox(o, d, glm::vec3(-0.5f), glm::vec3(lattice.dims) - 0.5f, t,
+                tExit, axis))
+      return false;
+
+    // Walk in grid coordinates, where cell i spans [i, i + 1)
+    glm::vec3 g = o + glm::vec3(0.5f);
+    glm::vec3 p = g + d * t;
+    glm::ivec3 start;
+    for (int i = 0; i < 3; ++i) {
+      start[i] = glm::clamp((int)std::floor(p[i]), 0, lattice.dims[i] - 1);
+    }
+    GridWalk walk(g, d, start);
+
+    while (true) {
+      const glm::ivec3 &cell = walk.cell;
+      int c = lattice.cellIndex(cell.x, cell.y, cell.z);
+      if (lattice.occupied(c)) {
+        glm::vec3 n(0.0f);
+        if (axis >= 0)
+          n[axis] = (float)-walk.step[axis];
+        hit.t = t;
+        hit.cube = handleAt(slots[lattice.cellCube[c]].dense);
+        // started inside a cube, face the ray
+        hit.normal = axis >= 0 ? lattice.rotation * n : -dir;
+        return true;
+      }
+      t = walk.next();
+      axis = walk.axis;
+      if (t > tExit)
+        return false;
+      if (cell[axis] < 0 || cell[axis] >= lattice.dims[axis])
+        return false;
     }
-    return hits;
   };
 
-  // Fracture cube, add to freeCubes
-  void fracturedCube(int k, const glm::vec3 &impactPoint,
+  // Fracture cube, add it to the debris. O(1): the last cube of the draw list
+  // moves into the hole and only that one matrix is marked for upload.
+  void fracturedCube(CubeHandle h, const glm::vec3 &impactPoint,
                      const glm::vec3 &bulletVelocity) {
+    if (!isAlive(h))
+      return; // already knocked out by an earlier hit
+    CubeSlot &slot = slots[h.slot];
+    int k = slot.dense;
     glm::vec3 cubePos = glm::vec3(modelMatsStatic[k][3]);
 
-    // mark the particle free
-    particles[k]->fixed = false;
-    // remove all springs attached to that particle
-    springs.erase(remove_if(begin(springs), end(springs),
-                            [&](auto &s) {
-                              return s->p0 == particles[k] ||
-                                     s->p1 == particles[k];
-                            }),
-                  end(springs));
-
-    // move its model matrix into freeCubes for separate physics, erase from
-    // instance
-    modelMatsStatic.erase(modelMatsStatic.begin() + k);
-    uploadInstanceBuffer();
+    // mark the particle free and drop the springs attached to it
+    particles[h.slot]->fixed = false;
+    while (slot.springCount > 0) {
+      removeSpring(slot.springs[0]);
+    }
+
+    // swap-remove from the draw list
+    int last = (int)modelMatsStatic.size() - 1;
+    if (k != last) {
+      modelMatsStatic[k] = modelMatsStatic[last];
+      denseSlot[k] = denseSlot[last];
+      slots[denseSlot[k]].dense = k;
+      setCenter(k);
+    }
+    modelMatsStatic.pop_back();
+    denseSlot.pop_back();
+    centerX.pop_back();
+    centerY.pop_back();
+    centerZ.pop_back();
+    if (k < last)
+      markDirty(k, 1);
+
+    if (slot.cell >= 0 && lattice.valid()) {
+      lattice.setOccupied(slot.cell, false);
+      lattice.cellCube[slot.cell] = -1;
+      markCellDirty(slot.cell);
+    }
+    slot.dense = -1;
+    slot.cell = -1;
+    slot.generation++;
+    freeSlots.push_back(h.slot);
+    boundsDirty = true;
 
     // compute radial blast direction
     glm::vec3 dir = cubePos - impactPoint;
@@ -334,41 +764,225 @@ public:
     dir = glm::normalize(dir);
 
     float blastStrength = 15.0f;
-    FreeCube cc;
-    cc.position = glmVec3ToEigen(cubePos);
-    cc.velocity = glmVec3ToEigen(dir * blastStrength + bulletVelocity * 0.5f);
-    cc.size = 1.0f;
-    freeCubes.push_back(cc);
-    // std::cout << "[fracture] freeCubes now = " << freeCubes.size()
-    //           << " (spawned at " << cubePos.x << "," << cubePos.y << ","
-    //           << cubePos.z << ")\n";
+    debris.spawn(cubePos, dir * blastStrength + bulletVelocity * 0.5f, 1.0f);
   };
 
   // GETTERS and SETTERS
   GLuint getInstanceVBO() { return this->instanceVBO; };
-  // Append to modelMatsStatic
-  void pushBackModelMat(glm::mat4 mat) { modelMatsStatic.push_back(mat); };
+  size_t getInstanceBase() const { return this->instanceBase; };
+  // Append a cube to the pool, reusing a free slot when there is one
+  CubeHandle pushBackModelMat(glm::mat4 mat) {
+    uint32_t s;
+    if (!freeSlots.empty()) {
+      s = freeSlots.back();
+      freeSlots.pop_back();
+    } else {
+      s = (uint32_t)slots.size();
+      slots.push_back(CubeSlot());
+    }
+    slots[s].dense = (int)modelMatsStatic.size();
+    modelMatsStatic.push_back(mat);
+    denseSlot.push_back(s);
+    centerX.push_back(mat[3].x);
+    centerY.push_back(mat[3].y);
+    centerZ.push_back(mat[3].z);
+    boundsDirty = true;
+    return CubeHandle{s, slots[s].generation};
+  };
 
   bool collidesAABB(glm::vec3 pMin, glm::vec3 pMax) const {
     const float half = 0.5f;
-    for (auto &M : modelMatsStatic) {
-      glm::vec3 c = glm::vec3(M[3]);
-      glm::vec3 cMin = c - glm::vec3(half);
-      glm::vec3 cMax = c + glm::vec3(half);
+    bool hit = false;
+    forEachCubeCenterInBox(
+        AABB(pMin - glm::vec3(half), pMax + glm::vec3(half)),
+        [&](int, const glm::vec3 &c) {
+          if (hit)
+            return;
+          glm::vec3 cMin = c - glm::vec3(half);
+          glm::vec3 cMax = c + glm::vec3(half);
+
+          // 1) if your slab is completely below this cube, skip it
+          if (pMax.y <= cMin.y)
+            return;
+          // 2) if your slab is completely above this cube, skip it (optional)
+          if (pMin.y > cMax.y)
+            return;
+
+          // 3) now do the XZ overlap test
+          if (pMin.x < cMax.x && pMax.x > cMin.x && pMin.z < cMax.z &&
+              pMax.z > cMin.z) {
+            hit = true;
+          }
+        });
+    return hit;
+  }
 
-      // 1) if your slab is completely below this cube, skip it
-      if (pMax.y <= cMin.y)
-        continue;
-      // 2) if your slab is completely above this cube, skip it (optional)
-      if (pMin.y > cMax.y)
-        continue;
+  // raycast for structures off the lattice: every cube under the segment,
+  // each as a unit box in its own frame
+  bool raycastCubes(const glm::vec3 &origin, const glm::vec3 &dir,
+                    RayHit &hit) const {
+    float maxT = std::min(hit.t, 1e4f);
+    bool found = false;
+    AABB reach = sweptBounds(origin, origin + dir * maxT, 0.8661f);
+    forEachCubeCenterInBox(reach, [&](int k, const glm::vec3 &c) {
+      glm::mat3 R, Rt;
+      cubeFrame(k, R, Rt);
+      glm::vec3 o = Rt * (origin - c);
+      glm::vec3 d = Rt * dir;
+      float t0 = 0.0f, t1 = hit.t;
+      int axis;
+      if (!rayBox(o, d, glm::vec3(-0.5f), glm::vec3(0.5f), t0, t1, axis))
+        return;
+      glm::vec3 n(0.0f);
+      if (axis >= 0)
+        n[axis] = d[axis] > 0.0f ? -1.0f : 1.0f;
+      hit.t = t0;
+      hit.cube = handleAt(k);
+      hit.normal = axis >= 0 ? R * n : -dir;
+      found = true;
+    });
+    return found;
+  };
 
-      // 3) now do the XZ overlap test
-      if (pMin.x < cMax.x && pMax.x > cMin.x && pMin.z < cMax.z &&
-          pMax.z > cMin.z) {
-        return true;
+  // LATTICE
+  // Called by createStructure before any cube is pushed
+  void setLattice(const glm::vec3 &origin, const glm::mat3 &rotation,
+                  const glm::ivec3 &dims) {
+    lattice.origin = origin;
+    lattice.rotation = rotation;
+    latticeRotT = glm::transpose(rotation);
+    lattice.dims = dims;
+    int cells = dims.x * dims.y * dims.z;
+    lattice.occupancy.assign((cells + 63) / 64, 0ull);
+    lattice.cellCube.assign(cells, -1);
+    if (meshMode)
+      buildMeshChunks();
+  };
+  // Append a cube that occupies lattice cell (i, j, k)
+  CubeHandle pushBackModelMat(glm::mat4 mat, const glm::ivec3 &cell) {
+    CubeHandle h = pushBackModelMat(mat);
+    int c = lattice.cellIndex(cell.x, cell.y, cell.z);
+    lattice.setOccupied(c, true);
+    lattice.cellCube[c] = (int)h.slot;
+    slots[h.slot].cell = c;
+    markCellDirty(c);
+    return h;
+  };
+  const Lattice &getLattice() const { return this->lattice; };
+
+  // Calls fn(k, center) for every static cube whose center lies in box,
+  // bounds included. Small boxes walk the lattice cells under them; big
+  // ones, and structures without a lattice, run the SIMD kernel over every
+  // center instead, whichever touches less.
+  template <typename F>
+  void forEachCubeCenterInBox(const AABB &box, F &&fn) const {
+    int lo[3], hi[3];
+    if (lattice.valid()) {
+      if (!latticeRange(box, lo, hi))
+        return;
+      if (cellCount(lo, hi) <= centerX.size()) {
+        walkCells(lo, hi, [&](int k) {
+          glm::vec3 c(centerX[k], centerY[k], centerZ[k]);
+          if (box.contains(c))
+            fn(k, c);
+        });
+        return;
+      }
+    }
+    scanCenters(
+        [&](size_t base, size_t n, uint64_t *mask) {
+          CubeKernels::boxMask(&centerX[base], &centerY[base], &centerZ[base],
+                               n, box.min, box.max, mask);
+        },
+        fn);
+  }
+
+  // Same for centers within radius of p
+  template <typename F>
+  void forEachCubeCenterInSphere(const glm::vec3 &p, float radius,
+                                 F &&fn) const {
+    int lo[3], hi[3];
+    if (lattice.valid()) {
+      AABB box(p - glm::vec3(radius), p + glm::vec3(radius));
+      if (!latticeRange(box, lo, hi))
+        return;
+      if (cellCount(lo, hi) <= centerX.size()) {
+        walkCells(lo, hi, [&](int k) {
+          glm::vec3 c(centerX[k], centerY[k], centerZ[k]);
+          glm::vec3 d = c - p;
+          if (glm::dot(d, d) <= radius * radius)
+            fn(k, c);
+        });
+        return;
+      }
+    }
+    scanCenters(
+        [&](size_t base, size_t n, uint64_t *mask) {
+          CubeKernels::sphereMask(&centerX[base], &centerY[base],
+                                  &centerZ[base], n, p, radius, mask);
+        },
+        fn);
+  }
+
+private:
+  // Lattice cells under a world box, false if it misses the lattice
+  bool latticeRange(const AABB &box, int lo[3], int hi[3]) const {
+    // Box into lattice space
+    const glm::mat3 &Rt = latticeRotT;
+    glm::vec3 c = Rt * (box.center() - lattice.origin);
+    glm::vec3 e = 0.5f * (box.max - box.min);
+    glm::vec3 ext;
+    for (int i = 0; i < 3; ++i) {
+      ext[i] = fabs(Rt[0][i]) * e.x + fabs(Rt[1][i]) * e.y +
+               fabs(Rt[2][i]) * e.z + 1e-4f;
+    }
+    for (int i = 0; i < 3; ++i) {
+      lo[i] = std::max(0, (int)std::ceil(c[i] - ext[i]));
+      hi[i] = std::min(lattice.dims[i] - 1, (int)std::floor(c[i] + ext[i]));
+      if (lo[i] > hi[i])
+        return false;
+    }
+    return true;
+  };
+
+  static size_t cellCount(const int lo[3], const int hi[3]) {
+    return (size_t)(hi[0] - lo[0] + 1) * (hi[1] - lo[1] + 1) *
+           (hi[2] - lo[2] + 1);
+  };
+
+  // fn(k) for the occupied cells in [lo, hi]
+  template <typename F>
+  void walkCells(const int lo[3], const int hi[3], F &&fn) const {
+    for (int k = lo[2]; k <= hi[2]; ++k) {
+      for (int j = lo[1]; j <= hi[1]; ++j) {
+        for (int i = lo[0]; i <= hi[0]; ++i) {
+          int cell = lattice.cellIndex(i, j, k);
+          if (lattice.occupied(cell)) {
+            fn(slots[lattice.cellCube[cell]].dense);
+          }
+        }
+      }
+    }
+  }
+
+  // Runs kernel(base, n, mask) over the centers a chunk at a time (the mask
+  // stays on the stack) and calls fn(k, center) for every bit it sets
+  template <typename K, typename F>
+  void scanCenters(K &&kernel, F &&fn) const {
+    const size_t CHUNK = 4096;
+    uint64_t mask[CHUNK / 64];
+    size_t count = centerX.size();
+    for (size_t base = 0; base < count; base += CHUNK) {
+      size_t n = std::min(CHUNK, count - base);
+      kernel(base, n, mask);
+      for (size_t w = 0; w < CubeKernels::maskWords(n); ++w) {
+        uint64_t bits = mask[w];
+        while (bits) {
+          int k = (int)(base + w * 64 + CubeKernels::lowestBit(bits));
+          bits &= bits - 1;
+          fn(k, glm::vec3(centerX[k], centerY[k], centerZ[k]));
+        }
       }
     }
-    return false;
   }
 };
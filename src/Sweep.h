@@ -0,0 +1,71 @@
+#pragma once
+
+#include "AABB.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <utility>
+
+// Continuous collision helpers. A moving sphere goes from -> from + move
+// over one step; times are fractions of that step, 0 to 1.
+
+// Box around everything the sphere touches during the step
+inline AABB sweptBounds(const glm::vec3 &from, const glm::vec3 &to,
+                        float radius) {
+  return AABB(glm::min(from, to) - glm::vec3(radius),
+              glm::max(from, to) + glm::vec3(radius));
+}
+
+// Moving point vs a static sphere of radius reach (the two radii summed).
+// Sets t to the first contact if it is before the current t. A start inside
+// the sphere counts as a hit at 0 only while moving inwards, so something
+// that was just pushed out or bounced off is not caught again.
+inline bool sweepSphere(const glm::vec3 &from, const glm::vec3 &move,
+                        const glm::vec3 &center, float reach, float &t) {
+  glm::vec3 m = from - center;
+  float b = glm::dot(m, move);
+  float c = glm::dot(m, m) - reach * reach;
+  if (b >= 0.0f)
+    return false; // not closing in
+  if (c <= 0.0f) {
+    t = 0.0f;
+    return true;
+  }
+  float a = glm::dot(move, move);
+  float disc = b * b - a * c;
+  if (disc < 0.0f)
+    return false;
+  float hit = (-b - std::sqrt(disc)) / a;
+  if (hit > t)
+    return false;
+  t = hit;
+  return true;
+}
+
+// Ray o + d * t against the box [lo, hi] (slab test). Narrows [tMin, tMax]
+// to the part of the ray inside the box and sets axis to the axis of the
+// face the ray enters through, -1 if it starts inside. False on a miss.
+inline bool rayBox(const glm::vec3 &o, const glm::vec3 &d, const glm::vec3 &lo,
+                   const glm::vec3 &hi, float &tMin, float &tMax, int &axis) {
+  axis = -1;
+  for (int i = 0; i < 3; ++i) {
+    if (std::fabs(d[i]) < 1e-12f) {
+      if (o[i] < lo[i] || o[i] > hi[i])
+        return false;
+      continue;
+    }
+    float inv = 1.0f / d[i];
+    float t0 = (lo[i] - o[i]) * inv;
+    float t1 = (hi[i] - o[i]) * inv;
+    if (t0 > t1)
+      std::swap(t0, t1);
+    if (t0 > tMin) {
+      tMin = t0;
+      axis = i;
+    }
+    tMax = std::min(tMax, t1);
+    if (tMin > tMax)
+      return false;
+  }
+  return true;
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include "DynamicRing.h"
+#include "FrameStats.h"
+#include "Frustum.h"
+#include "InstanceData.h"
+#include "Program.h"
+#include "Shape.h"
+#include "SpatialHash.h"
+#include "Sweep.h"
+#include "VaoCache.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+// The targets (bunnies) as parallel arrays, one entry per target, dead ones
+// included so indices stay put. All targets share one mesh and are drawn in
+// one instanced draw, each with its own colour. Bullets find the targets
+// near them through a spatial hash instead of testing every one.
+class TargetSystem {
+private:
+  std::shared_ptr<Shape> mesh;
+  float radius; // collision radius at scale 1, around the position
+
+  std::vector<glm::vec3> positions; // where the mesh's base center sits
+  std::vector<float> scales;
+  std::vector<uint8_t> alive;
+  std::vector<uint32_t> colors; // rgba8, alpha 0 so the shader uses it
+  int aliveCount = 0;
+  float maxScale = 0.0f;
+
+  SpatialHash hash;
+  bool hashDirty = true;
+  std::mt19937 rng{std::random_device{}()}; // seeded once, not per target
+
+  void rebuildHash() {
+    // a cell spans a bullet's reach on both sides, so each step of a
+    // segment walk reads at most three cells per axis
+    float cell = std::max(2.0f * radius * maxScale + 1.0f, 1.0f);
+    hash.build(positions.data(), positions.size(), cell);
+    hashDirty = false;
+  };
+
+public:
+  TargetSystem(std::shared_ptr<Shape> mesh, float radius)
+      : mesh(mesh), radius(radius) {};
+
+  void add(const glm::vec3 &position, float scale = 1.0f) {
+    // random diffuse colour, 0.01 to 1 per channel like the old Objects
+    std::uniform_int_distribution<> dis(1, 100);
+    uint8_t rgba[4] = {(uint8_t)(dis(rng) * 255 / 100),
+                       (uint8_t)(dis(rng) * 255 / 100),
+                       (uint8_t)(dis(rng) * 255 / 100), 0};
+    uint32_t color;
+    memcpy(&color, rgba, sizeof(color));
+
+    positions.push_back(position);
+    scales.push_back(scale);
+    alive.push_back(1);
+    colors.push_back(color);
+    aliveCount++;
+    maxScale = std::max(maxScale, scale);
+    hashDirty = true;
+  };
+
+  void clear() {
+    positions.clear();
+    scales.clear();
+    alive.clear();
+    colors.clear();
+    aliveCount = 0;
+    maxScale = 0.0f;
+    hash.clear();
+    hashDirty = false;
+  };
+
+  void kill(int i) {
+    if (alive[i]) {
+      alive[i] = 0;
+      aliveCount--;
+    }
+  };
+
+  // First live target a sphere moving from -> to runs into before t (a
+  // fraction of the move), see Sweep.h. Returns its index and sets t, or
+  // returns -1. Nothing is killed.
+  int sweepSphere(const glm::vec3 &from, const glm::vec3 &to, float r,
+                  float &t) {
+    if (aliveCount == 0)
+      return -1;
+    if (hashDirty)
+      rebuildHash();
+    int hit = -1;
+    glm::vec3 move = to - from;
+    hash.querySegment(from, to, r + radius * maxScale, [&](int i) {
+      if (alive[i] && ::sweepSphere(from, move, positions[i],
+                                    r + radius * scales[i], t))
+        hit = i;
+      return true;
+    });
+    return hit;
+  };
+
+  // First live target along origin + dir * t (dir unit length) before dist,
+  // the segment swept as a point. Returns its index and sets dist, or
+  // returns -1. Nothing is killed.
+  int raycast(const glm::vec3 &origin, const glm::vec3 &dir, float &dist) {
+    float t = 1.0f;
+    int hit = sweepSphere(origin, origin + dir * dist, 0.0f, t);
+    if (hit >= 0)
+      dist *= t;
+    return hit;
+  };
+
+  // Every live target in the frustum, in one draw. The transform is the one
+  // Object used, the mesh pushed onto the floor and scaled about its base
+  // center, folded into the instance's posScale.
+  void render(const std::shared_ptr<Program> &prog, const Frustum &frustum) {
+    if (aliveCount == 0)
+      return;
+    DynamicRing::Alloc ring = dynamicRing.alloc(
+        aliveCount * sizeof(TargetInstance), sizeof(TargetInstance));
+    if (!ring)
+      return;
+
+    glm::vec3 base = mesh->getBaseCenter();
+    glm::vec3 lift(0.0f, -mesh->getMinY(), 0.0f);
+    glm::vec3 sphereCenter = mesh->getSphereCenter();
+    float sphereRadius = mesh->getSphereRadius();
+    TargetInstance *out = (TargetInstance *)ring.ptr;
+    size_t visible = 0;
+    for (size_t i = 0; i < positions.size(); ++i) {
+      if (!alive[i])
+        continue;
+      float s = scales[i];
+      glm::vec3 offset = positions[i] + lift + base * (1.0f - s);
+      if (!frustum.intersectsSphere(offset + s * sphereCenter,
+                                    s * sphereRadius))
+        continue;
+      TargetInstance &t = out[visible++];
+      t.posScale = glm::vec4(offset, s);
+      memcpy(t.color, &colors[i], sizeof(t.color));
+    }
+    countInstances(visible, aliveCount);
+    if (visible == 0)
+      return;
+    dynamicRing.commit(ring, visible * sizeof(TargetInstance));
+
+    const VaoCache::Entry &vao =
+        vaoCache.get(VertexSource::of(*mesh), *prog, dynamicRing.getBuffer(),
+                     InstanceFormat::TARGETS);
+    VaoCache::drawInstanced(vao, mesh->getDrawCount(), (GLsizei)visible,
+                            (GLuint)(ring.offset / sizeof(TargetInstance)));
+  };
+
+  size_t size() const { return this->positions.size(); };
+  int getAliveCount() const { return this->aliveCount; };
+  const glm::vec3 &getPosition(int i) const { return positions[i]; };
+  bool isAlive(int i) const { return alive[i] != 0; };
+};
@@ -1,5 +1,12 @@
 // TextRenderer.cpp
 #include "TextRenderer.h"
+#include "DynamicRing.h"
+#include "GLState.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <glm/gtc/matrix_transform.hpp>
 #include <ft2build.h>
 #include FT_FREETYPE_H
 
@@ -14,69 +21,169 @@ void TextRenderer::Init(const std::string &fontFile, GLuint fontSize,
   FT_Set_Pixel_Sizes(face, 0, fontSize);
   glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
-  // 3) load first 128 ASCII chars
+  projection = TextShader->uniform<glm::mat4>("projection");
+  textSampler = TextShader->uniform<int>("text");
+
+  // 3) load first 128 ASCII chars, packed into rows of one atlas. 1 pixel of
+  // padding around each glyph so linear filtering doesn't bleed.
+  const int ATLAS_WIDTH = 512;
+  std::vector<GLubyte> pixels;
+  int penX = 1, penY = 1, rowHeight = 0;
   for (GLubyte c = 0; c < 128; c++) {
     FT_Load_Char(face, c, FT_LOAD_RENDER);
-    GLuint tex;
-    glGenTextures(1, &tex);
-    glBindTexture(GL_TEXTURE_2D, tex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, face->glyph->bitmap.width,
-                 face->glyph->bitmap.rows, 0, GL_RED, GL_UNSIGNED_BYTE,
-                 face->glyph->bitmap.buffer);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    const FT_Bitmap &bmp = face->glyph->bitmap;
+    int w = bmp.width, h = bmp.rows;
+    if (penX + w + 1 > ATLAS_WIDTH) {
+      penX = 1;
+      penY += rowHeight + 1;
+      rowHeight = 0;
+    }
+    if ((int)pixels.size() < (penY + h + 1) * ATLAS_WIDTH)
+      pixels.resize((penY + h + 1) * ATLAS_WIDTH, 0);
+    for (int r = 0; r < h; ++r) {
+      memcpy(&pixels[(penY + r) * ATLAS_WIDTH + penX],
+             bmp.buffer + r * bmp.pitch, w);
+    }
 
-    Character ch = {tex,
-                    {face->glyph->bitmap.width, face->glyph->bitmap.rows},
-                    {face->glyph->bitmap_left, face->glyph->bitmap_top},
-                    (GLuint)face->glyph->advance.x};
-    Characters.insert(std::pair<GLchar, Character>(c, ch));
+    Character &ch = Characters[c];
+    ch.uv0 = glm::vec2(penX, penY); // in pixels until the height is known
+    ch.uv1 = glm::vec2(penX + w, penY + h);
+    ch.Size = glm::ivec2(w, h);
+    ch.Bearing = glm::ivec2(face->glyph->bitmap_left, face->glyph->bitmap_top);
+    ch.Advance = (GLuint)face->glyph->advance.x;
+    penX += w + 1;
+    rowHeight = std::max(rowHeight, h);
   }
   FT_Done_Face(face);
   FT_Done_FreeType(ft);
 
-  // 4) configure VAO/VBO for quads
+  int atlasHeight = 1;
+  while (atlasHeight * ATLAS_WIDTH < (int)pixels.size())
+    atlasHeight *= 2;
+  pixels.resize(atlasHeight * ATLAS_WIDTH, 0);
+  glm::vec2 atlasSize(ATLAS_WIDTH, atlasHeight);
+  for (auto &ch : Characters) {
+    ch.uv0 /= atlasSize;
+    ch.uv1 /= atlasSize;
+  }
+  glGenTextures(1, &atlas);
+  glState.bindTexture(0, atlas);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, ATLAS_WIDTH, atlasHeight, 0, GL_RED,
+               GL_UNSIGNED_BYTE, pixels.data());
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  // 4) configure VAO for quads. The vertices come from the dynamic ring, read
+  // from its start; Draw picks its vertices with the first vertex index.
   glGenVertexArrays(1, &VAO);
-  glGenBuffers(1, &VBO);
-  glBindVertexArray(VAO);
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 6 * 4, nullptr,
-               GL_DYNAMIC_DRAW);
-  glEnableVertexAttribArray(TextShader->getAttribute("aPos"));
-  glVertexAttribPointer(TextShader->getAttribute("aPos"), 4, GL_FLOAT, GL_FALSE,
-                        4 * sizeof(GLfloat), 0);
+  glState.bindVertexArray(VAO);
+  glBindBuffer(GL_ARRAY_BUFFER, dynamicRing.getBuffer());
+  GLint aPos = TextShader->getAttribute("aPos");
+  GLint aTex = TextShader->getAttribute("aTex");
+  GLint aColor = TextShader->getAttribute("aColor");
+  glEnableVertexAttribArray(aPos);
+  glVertexAttribPointer(aPos, 2, GL_FLOAT, GL_FALSE, sizeof(TextVertex),
+                        (void *)offsetof(TextVertex, x));
+  glEnableVertexAttribArray(aTex);
+  glVertexAttribPointer(aTex, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(TextVertex),
+                        (void *)offsetof(TextVertex, u));
+  glEnableVertexAttribArray(aColor);
+  glVertexAttribPointer(aColor, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+                        sizeof(TextVertex), (void *)offsetof(TextVertex, rgba));
   glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindVertexArray(0);
 }
 
-void TextRenderer::RenderText(const std::string &text, GLfloat x, GLfloat y,
-                              GLfloat scale, const glm::vec3 &color,
-                              std::shared_ptr<Program> &TextShader) {
-  // assume orthographic projection already set:
-  glUniform3f(TextShader->getUniform("textColor"), color.x, color.y, color.z);
-  glActiveTexture(GL_TEXTURE0);
-  glBindVertexArray(VAO);
+void TextRenderer::setScreen(int width, int height) {
+  projection.set(glm::ortho(0.0f, float(width), 0.0f, float(height)));
+  textSampler.set(0);
+}
 
-  for (auto c : text) {
-    Character &ch = Characters[c];
+static GLushort packUnorm16(float v) {
+  return (GLushort)std::lround(std::min(std::max(v, 0.0f), 1.0f) * 65535.0f);
+}
+
+void TextRenderer::layout(TextLine &line) {
+  line.vertices.clear();
+  line.vertices.reserve(line.text.size() * 6);
+  GLubyte rgba[4];
+  for (int i = 0; i < 3; ++i) {
+    float c = std::min(std::max(line.color[i], 0.0f), 1.0f);
+    rgba[i] = (GLubyte)std::lround(c * 255.0f);
+  }
+  rgba[3] = 255;
+
+  GLfloat x = line.x, scale = line.scale;
+  for (char c : line.text) {
+    if ((unsigned char)c >= 128)
+      continue;
+    const Character &ch = Characters[(unsigned char)c];
     GLfloat xpos = x + ch.Bearing.x * scale;
-    GLfloat ypos = y - (ch.Size.y - ch.Bearing.y) * scale;
+    GLfloat ypos = line.y - (ch.Size.y - ch.Bearing.y) * scale;
     GLfloat w = ch.Size.x * scale;
     GLfloat h = ch.Size.y * scale;
-    // update VBO for each glyph quad
-    GLfloat vertices[6][4] = {
-        {xpos, ypos + h, 0.0f, 0.0f},    {xpos, ypos, 0.0f, 1.0f},
-        {xpos + w, ypos, 1.0f, 1.0f},
+    GLushort u0 = packUnorm16(ch.uv0.x), v0 = packUnorm16(ch.uv0.y);
+    GLushort u1 = packUnorm16(ch.uv1.x), v1 = packUnorm16(ch.uv1.y);
+    TextVertex quad[6] = {
+        {xpos, ypos + h, u0, v0, {}},    {xpos, ypos, u0, v1, {}},
+        {xpos + w, ypos, u1, v1, {}},
 
-        {xpos, ypos + h, 0.0f, 0.0f},    {xpos + w, ypos, 1.0f, 1.0f},
-        {xpos + w, ypos + h, 1.0f, 0.0f}};
-    glBindTexture(GL_TEXTURE_2D, ch.TextureID);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
+        {xpos, ypos + h, u0, v0, {}},    {xpos + w, ypos, u1, v1, {}},
+        {xpos + w, ypos + h, u1, v0, {}}};
+    for (auto &v : quad) {
+      memcpy(v.rgba, rgba, sizeof(rgba));
+      line.vertices.push_back(v);
+    }
     x += (ch.Advance >> 6) * scale; // advance.x is in 1/64 pixels
   }
-  glBindVertexArray(0);
+}
+
+void TextRenderer::SetLine(size_t slot, const std::string &text, GLfloat x,
+                           GLfloat y, GLfloat scale, const glm::vec3 &color) {
+  if (slot >= lines.size())
+    lines.resize(slot + 1);
+  TextLine &line = lines[slot];
+  line.shown = true;
+  if (line.text == text && line.x == x && line.y == y && line.scale == scale &&
+      line.color == color)
+    return;
+  line.text = text;
+  line.x = x;
+  line.y = y;
+  line.scale = scale;
+  line.color = color;
+  layout(line);
+}
+
+void TextRenderer::Draw() {
+  size_t count = 0;
+  for (auto &line : lines) {
+    if (line.shown)
+      count += line.vertices.size();
+  }
+  if (count > 0) {
+    // all lines go into the ring back to back, one draw for the lot
+    DynamicRing::Alloc ring = dynamicRing.alloc(count * sizeof(TextVertex));
+    if (ring) {
+      TextVertex *out = (TextVertex *)ring.ptr;
+      for (auto &line : lines) {
+        if (!line.shown)
+          continue;
+        memcpy(out, line.vertices.data(),
+               line.vertices.size() * sizeof(TextVertex));
+        out += line.vertices.size();
+      }
+      dynamicRing.commit(ring, count * sizeof(TextVertex));
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+      glState.bindTexture(0, atlas);
+      glState.bindVertexArray(VAO);
+      glDrawArrays(GL_TRIANGLES, (GLint)(ring.offset / sizeof(TextVertex)),
+                   (GLsizei)count);
+    }
+  }
+  for (auto &line : lines) {
+    line.shown = false;
+  }
 }
@@ -3,28 +3,63 @@
 
 #include "Program.h"
 #include <GL/glew.h>
+#include <cstdint>
 #include <glm/glm.hpp>
-#include <map>
 #include <string>
+#include <vector>
 
 struct Character {
-  GLuint TextureID;   // ID handle of the glyph texture
+  glm::vec2 uv0, uv1; // top left and bottom right of the glyph in the atlas
   glm::ivec2 Size;    // size of glyph
   glm::ivec2 Bearing; // offset from baseline to left/top of glyph
   GLuint Advance;     // horizontal offset to advance to next glyph
 };
 
+// One text vertex, 16 bytes so vertex indices line up with ring offsets
+struct TextVertex {
+  GLfloat x, y;
+  GLushort u, v; // unorm16 atlas coordinates
+  GLubyte rgba[4];
+};
+static_assert(sizeof(TextVertex) == 16, "TextVertex must stay packed");
+
+// A laid out string. The vertices are only rebuilt when something about the
+// line changes.
+struct TextLine {
+  std::string text;
+  GLfloat x = 0.0f, y = 0.0f, scale = 0.0f;
+  glm::vec3 color = glm::vec3(-1.0f);
+  std::vector<TextVertex> vertices;
+  bool shown = false; // set this frame
+};
+
 class TextRenderer {
 public:
-  // holds a map of pre‑loaded Characters
-  std::map<GLchar, Character> Characters;
-  GLuint VAO, VBO;
+  // the first 128 ASCII characters, all in one atlas texture
+  Character Characters[128];
+  GLuint atlas = 0;
+  GLuint VAO;
+  // text shader uniforms, resolved in Init
+  Uniform<glm::mat4> projection;
+  Uniform<int> textSampler;
 
   // Initialize: load font at given size, compile text shader
   void Init(const std::string &fontFile, GLuint fontSize,
             std::shared_ptr<Program> &TextShader);
 
-  // Render text at (x,y) in pixels from lower‑left corner
-  void RenderText(const std::string &text, GLfloat x, GLfloat y, GLfloat scale,
-                  const glm::vec3 &color, std::shared_ptr<Program> &TextShader);
+  // Pixel projection for a width x height screen, text shader must be bound
+  void setScreen(int width, int height);
+
+  // Show text at (x,y) in pixels from lower‑left corner in line slot this
+  // frame. Layout is redone only when the line differs from last time.
+  void SetLine(size_t slot, const std::string &text, GLfloat x, GLfloat y,
+               GLfloat scale, const glm::vec3 &color);
+
+  // Every line set since the last Draw, in one draw call
+  void Draw();
+
+private:
+  std::vector<TextLine> lines;
+
+  void layout(TextLine &line);
 };
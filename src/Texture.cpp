@@ -1,4 +1,5 @@
 #include "Texture.h"
+#include "GLState.h"
 #include <iostream>
 #include <stdio.h>
 #include <stdlib.h>
@@ -43,7 +44,7 @@ void Texture::init() {
   // Generate a texture buffer object
   glGenTextures(1, &tid);
   // Bind the current texture to be the newly generated texture object
-  glBindTexture(GL_TEXTURE_2D, tid);
+  glState.bindTexture(0, tid);
   // Load the actual texture data
   // Base level is 0, number of channels is 3, and border is 0.
   glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format,
@@ -59,25 +60,23 @@ void Texture::init() {
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
                   GL_LINEAR_MIPMAP_LINEAR);
   // Unbind
-  glBindTexture(GL_TEXTURE_2D, 0);
+  glState.bindTexture(0, 0);
   // Free image, since the data is now on the GPU
   stbi_image_free(data);
 }
 
 void Texture::setWrapModes(GLint wrapS, GLint wrapT) {
   // Must be called after init()
-  glBindTexture(GL_TEXTURE_2D, tid);
+  glState.bindTexture(0, tid);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapS);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapT);
 }
 
 void Texture::bind(GLint handle) {
-  glActiveTexture(GL_TEXTURE0 + unit);
-  glBindTexture(GL_TEXTURE_2D, tid);
+  glState.bindTexture(unit, tid);
   glUniform1i(handle, unit);
 }
 
 void Texture::unbind() {
-  glActiveTexture(GL_TEXTURE0 + unit);
-  glBindTexture(GL_TEXTURE_2D, 0);
+  glState.bindTexture(unit, 0);
 }
@@ -16,6 +16,7 @@ public:
 	void init();
 	void setUnit(GLint u) { unit = u; }
 	GLint getUnit() const { return unit; }
+	GLuint getID() const { return tid; }
 	void bind(GLint handle);
 	void unbind();
 	void setWrapModes(GLint wrapS, GLint wrapT); // Must be called after init()
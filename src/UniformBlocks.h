@@ -0,0 +1,99 @@
+#pragma once
+
+#include "DynamicRing.h"
+#include "Material.h"
+#include <GL/glew.h>
+#include <algorithm>
+#include <cstring>
+#include <glm/glm.hpp>
+#include <memory>
+#include <vector>
+
+// Uniform blocks shared by every lit program (ARB_uniform_buffer_object).
+// The layouts below are std140 and must match the block declarations in
+// the shaders, which is why everything is a vec4/mat4.
+constexpr int NUM_LIGHTS = 2;
+constexpr int MAX_MATERIALS = 16;
+
+// Binding points, Program::bindBlock ties a program's blocks to these
+enum UniformBinding : GLuint { FRAME_BINDING = 0, MATERIALS_BINDING = 1 };
+
+// Camera and lights, written once per frame
+struct FrameBlock {
+  glm::mat4 P;
+  glm::mat4 V;                       // view, world to eye
+  glm::vec4 lightsPos[NUM_LIGHTS];   // eye space, w unused
+  glm::vec4 lightsColor[NUM_LIGHTS]; // w unused
+};
+
+struct MaterialEntry {
+  glm::vec4 ke;
+  glm::vec4 kd;
+  glm::vec4 ks; // w is the shininess s
+};
+
+// Every material, uploaded once. Programs pick one with their "material"
+// uniform.
+struct MaterialsBlock {
+  MaterialEntry materials[MAX_MATERIALS];
+};
+
+class UniformBlocks {
+private:
+  GLuint materialsUBO = 0;
+  GLint offsetAlign = 256;
+
+public:
+  UniformBlocks() = default;
+
+  // Called from main before the window goes, the global itself outlives the
+  // GL context
+  void release() {
+    if (materialsUBO)
+      glDeleteBuffers(1, &materialsUBO);
+    materialsUBO = 0;
+  };
+
+  void init(std::vector<std::shared_ptr<Material>> &materials) {
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offsetAlign);
+
+    MaterialsBlock block = {};
+    size_t n = std::min(materials.size(), (size_t)MAX_MATERIALS);
+    for (size_t i = 0; i < n; ++i) {
+      Material &m = *materials[i];
+      block.materials[i].ke = glm::vec4(m.getMaterialKE(), 0.0f);
+      block.materials[i].kd = glm::vec4(m.getMaterialKD(), 0.0f);
+      block.materials[i].ks = glm::vec4(m.getMaterialKS(), m.getMaterialS());
+    }
+    if (!materialsUBO)
+      glGenBuffers(1, &materialsUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, materialsUBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(block), &block, GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, MATERIALS_BINDING, materialsUBO);
+  };
+
+  // The frame block goes through the dynamic ring like the rest of the per
+  // frame data, so rewriting it never waits on last frame's draws
+  void updateFrame(const glm::mat4 &P, const glm::mat4 &V,
+                   const std::vector<glm::vec3> &viewLightPositions,
+                   const std::vector<glm::vec3> &lightColors) {
+    FrameBlock block = {};
+    block.P = P;
+    block.V = V;
+    size_t n = std::min(viewLightPositions.size(), (size_t)NUM_LIGHTS);
+    for (size_t i = 0; i < n; ++i) {
+      block.lightsPos[i] = glm::vec4(viewLightPositions[i], 1.0f);
+      block.lightsColor[i] = glm::vec4(lightColors[i], 0.0f);
+    }
+    DynamicRing::Alloc a = dynamicRing.alloc(sizeof(block), offsetAlign);
+    if (!a)
+      return; // ring full, the ring is sized so this doesn't happen
+    memcpy(a.ptr, &block, sizeof(block));
+    dynamicRing.commit(a, sizeof(block));
+    glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_BINDING,
+                      dynamicRing.getBuffer(), a.offset, sizeof(block));
+  };
+};
+
+inline UniformBlocks uniformBlocks;
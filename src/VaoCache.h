@@ -0,0 +1,176 @@
+#pragma once
+
+#include "GLState.h"
+#include "InstanceData.h"
+#include "Program.h"
+#include "Shape.h"
+#include <GL/glew.h>
+#include <map>
+#include <tuple>
+
+// One vertex attribute array: buffer, component count and type as
+// glVertexAttribPointer takes them. A zero buffer means the mesh has no such
+// attribute.
+struct VertexAttrib {
+  GLuint buf = 0;
+  GLint size = 3;
+  GLenum type = GL_FLOAT;
+  GLboolean normalized = GL_FALSE;
+  GLsizei stride = 0;
+  size_t offset = 0;
+};
+
+// Where a mesh's per vertex attributes live. Buffers may be shared
+// (interleaved) or separate. With an index buffer the mesh is drawn with
+// glDrawElements*, the binding is baked into the VAO.
+struct VertexSource {
+  VertexAttrib pos, nor, tex;
+  GLuint indexBuf = 0;
+  GLenum indexType = GL_UNSIGNED_INT;
+
+  static VertexSource of(const Shape &shape) {
+    const Shape::Layout &l = shape.getLayout();
+    GLuint buf = shape.getVertexBufID();
+    GLenum floatType = l.quantized ? GL_HALF_FLOAT : GL_FLOAT;
+    VertexSource v;
+    v.pos = {buf, 3, floatType, GL_FALSE, l.stride, 0};
+    if (l.norOffset >= 0 && l.quantized)
+      v.nor = {buf, 4, GL_INT_2_10_10_10_REV, GL_TRUE, l.stride,
+               (size_t)l.norOffset};
+    else if (l.norOffset >= 0)
+      v.nor = {buf, 3, GL_FLOAT, GL_FALSE, l.stride, (size_t)l.norOffset};
+    if (l.texOffset >= 0)
+      v.tex = {buf, 2, floatType, GL_FALSE, l.stride, (size_t)l.texOffset};
+    v.indexBuf = shape.getIndexBufID();
+    v.indexType =
+        shape.hasShortIndices() ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    return v;
+  };
+};
+
+// How the instance buffer of a VAO is laid out, see InstanceData.h
+enum class InstanceFormat { NONE, POS_SCALE, FULL, TARGETS };
+
+// Vertex layouts resolved once. Every (mesh, program, instance buffer,
+// instance format) gets its own VAO with all attribute pointers, enables and
+// divisors baked in on first use, so a draw is bind VAO + draw. VAOs are bound
+// through glState and left bound, the next draw with the same layout skips
+// the bind. Instances
+// always start at record 0 of the instance buffer; draws that want a later
+// range pass it as the base instance (see drawInstanced).
+class VaoCache {
+public:
+  struct Entry {
+    GLuint vao = 0;
+    GLuint instanceBuf = 0;
+    InstanceFormat format = InstanceFormat::NONE;
+    GLenum indexType = 0; // 0 when drawn with glDrawArrays*
+    InstanceAttribs inst; // for constant values and the re-point fallback
+    mutable GLuint pointedAt = 0; // record the instance pointers start at
+  };
+
+private:
+  // keyed by the position buffer, which names the mesh
+  typedef std::tuple<GLuint, const Program *, GLuint, InstanceFormat> Key;
+  std::map<Key, Entry> entries;
+
+  static void point(GLint loc, const VertexAttrib &a) {
+    if (loc < 0 || a.buf == 0)
+      return;
+    glBindBuffer(GL_ARRAY_BUFFER, a.buf);
+    glEnableVertexAttribArray(loc);
+    glVertexAttribPointer(loc, a.size, a.type, a.normalized, a.stride,
+                          (void *)a.offset);
+  }
+
+  static void pointInstances(const Entry &e, GLuint first) {
+    e.pointedAt = first;
+    glBindBuffer(GL_ARRAY_BUFFER, e.instanceBuf);
+    if (e.format == InstanceFormat::FULL)
+      e.inst.bind(first * sizeof(InstanceData));
+    else if (e.format == InstanceFormat::POS_SCALE)
+      e.inst.bindPosScale(first * sizeof(glm::vec4));
+    else if (e.format == InstanceFormat::TARGETS)
+      e.inst.bindTargets(first * sizeof(TargetInstance));
+  }
+
+public:
+  const Entry &get(const VertexSource &src, const Program &prog,
+                   GLuint instanceBuf = 0,
+                   InstanceFormat format = InstanceFormat::NONE) {
+    Key key(src.pos.buf, &prog, instanceBuf, format);
+    auto it = entries.find(key);
+    if (it != entries.end())
+      return it->second;
+
+    Entry e;
+    e.instanceBuf = instanceBuf;
+    e.format = format;
+    e.inst = InstanceAttribs(prog);
+    glGenVertexArrays(1, &e.vao);
+    glState.bindVertexArray(e.vao);
+    point(prog.getAttribute("aPos"), src.pos);
+    point(prog.getAttribute("aNor"), src.nor);
+    point(prog.getAttribute("aTex"), src.tex);
+    if (src.indexBuf) {
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, src.indexBuf);
+      e.indexType = src.indexType;
+    }
+    if (format != InstanceFormat::NONE)
+      pointInstances(e, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return entries.emplace(key, e).first->second;
+  };
+
+  // Draws count instances starting at record first of the entry's instance
+  // buffer. Without ARB_base_instance the instance pointers of the VAO are
+  // moved instead when first changed, the rest of the layout stays as baked.
+  // elements is the index count for indexed meshes, else the vertex count.
+  static void drawInstanced(const Entry &e, GLsizei elements, GLsizei count,
+                            GLuint first = 0) {
+    glState.bindVertexArray(e.vao);
+    if (GLEW_ARB_base_instance) {
+      if (e.indexType)
+        glDrawElementsInstancedBaseInstance(GL_TRIANGLES, elements,
+                                            e.indexType, (void *)0, count,
+                                            first);
+      else
+        glDrawArraysInstancedBaseInstance(GL_TRIANGLES, 0, elements, count,
+                                          first);
+    } else {
+      if (first != e.pointedAt)
+        pointInstances(e, first);
+      if (e.indexType)
+        glDrawElementsInstanced(GL_TRIANGLES, elements, e.indexType,
+                                (void *)0, count);
+      else
+        glDrawArraysInstanced(GL_TRIANGLES, 0, elements, count);
+    }
+  };
+
+  // Drop every VAO that reads buf, call before deleting a buffer whose name
+  // could be reused
+  void forget(GLuint buf) {
+    for (auto it = entries.begin(); it != entries.end();) {
+      if (std::get<0>(it->first) == buf || std::get<2>(it->first) == buf) {
+        glState.deletedVertexArray(it->second.vao);
+        glDeleteVertexArrays(1, &it->second.vao);
+        it = entries.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  };
+
+  // Deletes every VAO. vaoCache outlives the GL context, so main calls this
+  // before the window goes rather than leaving it to a destructor.
+  void release() {
+    for (auto &kv : entries) {
+      glState.deletedVertexArray(kv.second.vao);
+      glDeleteVertexArrays(1, &kv.second.vao);
+    }
+    entries.clear();
+  };
+};
+
+inline VaoCache vaoCache;
@@ -18,15 +18,17 @@ void Wall::createStructure(std::shared_ptr<Shape> cubeMesh, int width,
   float top = -cubeMesh->getMinY();
   float realHeight = top - bottom;
   float liftY = -bottom;
+  setLattice(center + glm::vec3(0.0f, liftY, 0.0f), glm::mat3(1.0f),
+             glm::ivec3(width, height, 1));
   for (int y = 0; y < height; ++y) {
     for (int x = 0; x < width; ++x) {
       glm::vec3 pos = center + glm::vec3(x * 1.0f, y * 1.0f + liftY, 0.0f);
       glm::mat4 model = glm::translate(glm::mat4(1.0f), pos);
-      pushBackModelMat(model);
+      CubeHandle h = pushBackModelMat(model, glm::ivec3(x, y, 0));
       auto p = make_shared<Particle>(cubeMesh);
       p->x = glmVec3ToEigen(glm::vec3(model[3]));
       p->fixed = true; // initially locked
-      pushToParticles(p);
+      setParticle(h, p);
     }
   }
 
@@ -37,8 +39,7 @@ void Wall::createStructure(std::shared_ptr<Shape> cubeMesh, int width,
     for (int x = 0; x < width - 1; ++x) {
       int idx0 = y * width + x;
       int idx1 = idx0 + 1;
-      pushToSprings(make_shared<Spring>(getParticleAtIdx(idx0),
-                                        getParticleAtIdx(idx1), ALPHA));
+      connectSlots(idx0, idx1, ALPHA);
     }
   }
   // vertical neighbors
@@ -46,8 +47,7 @@ void Wall::createStructure(std::shared_ptr<Shape> cubeMesh, int width,
     for (int x = 0; x < width; ++x) {
       int idx0 = y * width + x;
       int idx1 = idx0 + width;
-      pushToSprings(make_shared<Spring>(getParticleAtIdx(idx0),
-                                        getParticleAtIdx(idx1), ALPHA));
+      connectSlots(idx0, idx1, ALPHA);
     }
   }
   uploadInstanceBuffer();
@@ -60,16 +60,20 @@ void Wall::createStructure(std::shared_ptr<Shape> cubeMesh, int width,
   float realHeight = top - bottom;
   float liftY = -bottom;
   glm::mat4 rot = rotationAboutPoint(center, glm::radians(angle));
+  // rotation is about a vertical axis through center, so the lift is kept
+  setLattice(glm::vec3(rot * glm::vec4(center + glm::vec3(0.0f, liftY, 0.0f),
+                                       1.0f)),
+             glm::mat3(rot), glm::ivec3(width, height, 1));
   for (int y = 0; y < height; ++y) {
     for (int x = 0; x < width; ++x) {
       glm::vec3 pos = center + glm::vec3(x * 1.0f, y * 1.0f + liftY, 0.0f);
       glm::mat4 model = glm::translate(glm::mat4(1.0f), pos);
       model = rot * model;
-      pushBackModelMat(model);
+      CubeHandle h = pushBackModelMat(model, glm::ivec3(x, y, 0));
       auto p = make_shared<Particle>(cubeMesh);
       p->x = glmVec3ToEigen(glm::vec3(model[3]));
       p->fixed = true; // initially locked
-      pushToParticles(p);
+      setParticle(h, p);
     }
   }
 
@@ -80,8 +84,7 @@ void Wall::createStructure(std::shared_ptr<Shape> cubeMesh, int width,
     for (int x = 0; x < width - 1; ++x) {
       int idx0 = y * width + x;
       int idx1 = idx0 + 1;
-      pushToSprings(make_shared<Spring>(getParticleAtIdx(idx0),
-                                        getParticleAtIdx(idx1), ALPHA));
+      connectSlots(idx0, idx1, ALPHA);
     }
   }
   // vertical neighbors
@@ -89,8 +92,7 @@ void Wall::createStructure(std::shared_ptr<Shape> cubeMesh, int width,
     for (int x = 0; x < width; ++x) {
       int idx0 = y * width + x;
       int idx1 = idx0 + width;
-      pushToSprings(make_shared<Spring>(getParticleAtIdx(idx0),
-                                        getParticleAtIdx(idx1), ALPHA));
+      connectSlots(idx0, idx1, ALPHA);
     }
   }
   uploadInstanceBuffer();
@@ -1,5 +1,9 @@
 #include "GLFW/glfw3.h"
+#include "DynamicRing.h"
+#include "FrameStats.h"
+#include "RenderQueue.h"
 #include "TextRenderer.h"
+#include "UniformBlocks.h"
 #include "glm/matrix.hpp"
 #include "pch.h"
 #include <iterator>
@@ -60,7 +64,12 @@ shared_ptr<Shape> sphereMesh;
 shared_ptr<Shape> bunny;
 shared_ptr<BulletManager> bulletManager;
 std::vector<shared_ptr<Structure>> structures;
-std::vector<shared_ptr<Bunny>> bunnies;
+std::unique_ptr<TargetSystem> targets;
+int extraTargets = 0; // --targets N, scattered on top of the 24
+Broadphase structureBroadphase;
+StaticBatcher staticBatcher;
+RubbleBuffer rubble;
+RenderQueue renderQueue;
 
 // Textures
 shared_ptr<Texture> wallTex;
@@ -75,6 +84,7 @@ std::vector<std::shared_ptr<Object>> objects;
 
 // Lights, and Material stacks
 std::vector<shared_ptr<Program>> programs;
+std::vector<DrawUniforms> drawUniforms; // per program, same order
 std::vector<shared_ptr<Material>> materials;
 std::vector<shared_ptr<Light>> lights;
 
@@ -174,9 +184,19 @@ static void char_callback(GLFWwindow *window, unsigned int key) {
     player->setArmamentMode(1);
     break;
   }
+  case 'h': {
+    player->setArmamentMode(2);
+    break;
+  }
   case 'b': {
-    bunnies.clear();
+    targets->clear();
     NUM_BUNNIES = 0;
+    break;
+  }
+  case 'g': {
+    // instanced cubes by default, 'g' (or --mesh) for greedy meshed surfaces
+    setStructureMeshMode(structures, keyToggles[(unsigned)'g']);
+    break;
   }
   }
 }
@@ -206,9 +226,13 @@ static void init() {
   glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
   // Enable z-buffer test.
   glEnable(GL_DEPTH_TEST);
+  // Per frame debris/bullet instances and text quads, 2 MB a frame is far
+  // more than the debris budget and HUD ever need
+  dynamicRing.init(2 << 20);
 
-  createShaders(RESOURCE_DIR, programs);
+  createShaders(RESOURCE_DIR, programs, drawUniforms);
   createMaterials(materials);
+  uniformBlocks.init(materials);
   createSceneObjects(objects, RESOURCE_DIR);
 
   text.Init(RESOURCE_DIR + "JetBrainsMonoNerdFontMono-Italic.ttf", 24,
@@ -221,6 +245,7 @@ static void init() {
   camera->setInitDistance(2.0f); // Camera's initial Z translation
 
   // Frustrum
+  double meshStart = glfwGetTime();
   frustrum = make_shared<Shape>();
   frustrum->loadMesh(RESOURCE_DIR + "Frustrum.obj");
   frustrum->init();
@@ -240,6 +265,9 @@ static void init() {
   bunny->loadMesh(RESOURCE_DIR + "bunny.obj");
   bunny->init();
   bunny->setType(ShapeType::BUNNY);
+  cout << "Meshes: loaded in " << (glfwGetTime() - meshStart) * 1000.0
+       << " ms" << (bunny->isFromCache() ? " from the mesh cache" : "")
+       << endl;
 
   wallTex = make_shared<Texture>();
   wallTex->setFilename(RESOURCE_DIR + "Dungeon_brick_wall_grey.png");
@@ -249,17 +277,27 @@ static void init() {
 
   bulletManager = make_shared<BulletManager>(sphereMesh);
   player = make_shared<Player>(camera, bulletManager);
-  std::shared_ptr<Armament> pp_919 = make_shared<Armament>(100, 100);
+  std::shared_ptr<Armament> pp_919 = make_shared<Armament>(100, 100, 100);
   player->setWeapon(pp_919); // For more ammo
   player->setPlayerPos(glm::vec3(2.0f, 31.0f, 2.0f));
   player->setArmamentMode(1);
+  // Live debris limits, fractures past these evict the oldest cubes
+  debrisBudget.perStructureCap = 256;
+  debrisBudget.globalCap = 2048;
+  debrisBudget.rubbleCap = 4096;
   // Create structures
   initOuterAndFloors(structures, cubeMesh);
   initMaze(structures, cubeMesh, 30.0f);
   initMaze(structures, cubeMesh, 15.0f);
   initMaze(structures, cubeMesh, 0.0f);
-  initBunnies(bunnies, bunny, 31.0f);
-  NUM_BUNNIES = bunnies.size();
+  targets = std::make_unique<TargetSystem>(bunny, BUNNY_RADIUS);
+  initBunnies(*targets, 31.0f);
+  scatterBunnies(*targets, extraTargets, 31.0f);
+  NUM_BUNNIES = targets->getAliveCount();
+  buildStructureBroadphase(structureBroadphase, structures);
+  staticBatcher.build(cubeMesh, structures);
+  setStructureMeshMode(structures, keyToggles[(unsigned)'g']);
+  rubble.init(cubeMesh, debrisBudget.rubbleCap);
 
   std::shared_ptr<Light> lightSourceFloorThree = std::make_shared<Light>(
       glm::vec3(20.0f, 40.0f, 20.0f), glm::vec3(1.0f, 0.9f, 0.85f));
@@ -277,6 +315,7 @@ static void render() {
   double now = glfwGetTime();
   double deltaTime = now - lastTime;
   lastTime = now;
+  dynamicRing.beginFrame();
   // Clear framebuffer.
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   if (keyToggles[(unsigned)'c']) {
@@ -311,24 +350,41 @@ static void render() {
   }
 
   // armament ammunition
-  char armamentBuf[48];
+  char armamentBuf[64];
   auto [piercingAmmo, ricochetAmmo] = player->getArmament()->getAmmoLeft();
-  sprintf(armamentBuf, "[Ammo]  Piercing: %d   Ricochet: %d", piercingAmmo,
-          ricochetAmmo);
+  sprintf(armamentBuf, "[Ammo]  Piercing: %d   Ricochet: %d   Hit-scan: %d",
+          piercingAmmo, ricochetAmmo, player->getArmament()->getHitScanAmmo());
 
   char positionPlayerBuf[50];
   sprintf(positionPlayerBuf, "[X] %f [Y] %f [Z] %f", player->getPlayerPos().x,
           player->getPlayerPos().y, player->getPlayerPos().z);
 
+  // debug stats from the last frame
+  const FrameCounters &stats = frameStats.last;
+  char statsBuf[64];
+  sprintf(statsBuf, "[GPU] upload %.1f KB/frame  [CPU] kernels %s",
+          stats.bytesUploaded / 1024.0, CubeKernels::isa());
+  char cullBuf[96];
+  sprintf(cullBuf, "[Cull] structures %d/%d  instances %zu/%zu",
+          stats.structuresVisible,
+          stats.structuresVisible + stats.structuresCulled,
+          stats.instancesVisible,
+          stats.instancesVisible + stats.instancesCulled);
+  char stateBuf[96];
+  sprintf(stateBuf, "[State] programs %d  textures %d  VAOs %d  packets %d",
+          stats.programBinds, stats.textureBinds, stats.vaoBinds,
+          stats.drawPackets);
+
   // Get current frame buffer size.
   int width, height;
   glfwGetFramebufferSize(window, &width, &height);
   camera->setAspect((float)width / (float)height);
 
   // Game state
-  bunnyCollisions(bulletManager, bunnies, NUM_BUNNIES);
-  bulletManager->update(deltaTime, structures);
-  player->move(window, deltaTime, structures);
+  refitStructureBroadphase(structureBroadphase, structures);
+  NUM_BUNNIES -= bulletManager->update(deltaTime, structures,
+                                       structureBroadphase, *targets);
+  player->move(window, deltaTime, structures, structureBroadphase);
 
   //// DRAWING
   // Matrix stacks
@@ -344,45 +400,38 @@ static void render() {
   camera->applyViewMatrixFreeLook(MV);
 
   centerCam(MV);
+  // culling planes for everything drawn with this camera this frame
+  Frustum frustum(camera->getProjectionMatrix() * MV->topMatrix());
   shaderIndex = 1;
   shared_ptr<Program> activeProg = programs[shaderIndex];
   shared_ptr<Material> activeMaterial = materials[materialIndex];
 
-  // Draw text Infor at topleft
+  // Everything below is queued, flush sorts it by pass and state and draws
+  // Text info at topleft, on top of the scene
   activeProg = programs[4];
-  glEnable(GL_BLEND);
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-  activeProg->bind();
-  glUniformMatrix4fv(
-      activeProg->getUniform("projection"), 1, GL_FALSE,
-      glm::value_ptr(glm::ortho(0.0f, float(width), 0.0f, float(height))));
-  glUniform1i(activeProg->getUniform("text"), 0);
-  text.RenderText(timerBuf, 10.0f, height - 30.0f, 1.0f,
-                  glm::vec3(1.0f, 1.0f, 1.0f), activeProg);
-  text.RenderText(bunniesBuf, 10.0f, height - 60.0f, 1.0f,
-                  glm::vec3(1.0f, 1.0f, 1.0f), activeProg);
-  text.RenderText(armamentBuf, 10.0f, height - 90.0f, 1.0f,
-                  glm::vec3(1.0f, 1.0f, 1.0f), activeProg);
-  text.RenderText(positionPlayerBuf, 10.0f, height - 120.0f, 1.0f,
-                  glm::vec3(1.0f, 1.0f, 1.0f), activeProg);
-  activeProg->unbind();
+  renderQueue.setProgramSetup(
+      activeProg, [width, height]() { text.setScreen(width, height); });
+  // one slot per HUD line, only lines whose text changed get laid out again
+  const char *hudLines[] = {timerBuf, bunniesBuf, armamentBuf,
+                            positionPlayerBuf, statsBuf, cullBuf, stateBuf};
+  size_t shownLines = keyToggles[(unsigned)'i'] ? 7 : 4;
+  for (size_t i = 0; i < shownLines; ++i) {
+    text.SetLine(i, hudLines[i], 10.0f, height - 30.0f * (i + 1), 1.0f,
+                 glm::vec3(1.0f, 1.0f, 1.0f));
+  }
+  renderQueue.submit(RenderPass::OVERLAY, activeProg, text.atlas, text.VAO, 0,
+                     []() { text.Draw(); });
 
   activeProg = programs[1];
-  activeProg->bind();
-  glUniformMatrix4fv(activeProg->getUniform("P"), 1, GL_FALSE,
-                     glm::value_ptr(P->topMatrix()));
-  glUniformMatrix4fv(activeProg->getUniform("MV"), 1, GL_FALSE,
-                     glm::value_ptr(MV->topMatrix()));
-  glUniformMatrix3fv(activeProg->getUniform("T"), 1, GL_FALSE,
-                     glm::value_ptr(T));
   // GRIIIDS LINESSS
-  drawGridLines(activeProg, P, MV, T);
-  activeProg->unbind();
+  renderQueue.submit(RenderPass::SCENE, activeProg, 0, 0, 0,
+                     [prog = activeProg, &P, &MV]() mutable {
+                       drawGridLines(prog, drawUniforms[1], P, MV, T);
+                     });
 
   // SCENE , set prog to bling phong shader
   shaderIndex = 0;
   activeProg = programs[shaderIndex];
-  activeProg->bind();
   // Set light position uniform on the active program
   // CONVERT LIGHT WORLD SPACE COORDS TO EYE SPACE COORDS
   glm::mat4 viewMatrix = MV->topMatrix();
@@ -395,85 +444,66 @@ static void render() {
     viewLightPositions[i] = glm::vec3(viewPos);
     lightColors[i] = lights[i]->color;
   }
+  // shared by every lit program through the Frame uniform block
+  uniformBlocks.updateFrame(P->topMatrix(), viewMatrix, viewLightPositions,
+                            lightColors);
   float bricksPerUnit = 0.1f; // i.e. 2 bricks per 1m
-  GLint ts = activeProg->getUniform("tileScale");
-  glUniform1f(ts, bricksPerUnit);
-  drawLevel(activeProg, P, MV, T, lights, viewLightPositions, lightColors,
-            activeMaterial, materials, structures, textures, width, height,
-            deltaTime);
-  activeProg->unbind();
+  queueLevel(renderQueue, activeProg, drawUniforms[shaderIndex], MV,
+             materialIndex, bricksPerUnit, structures, staticBatcher, rubble,
+             frustum, textures, camera->getFar(), deltaTime);
 
   // Bullets
   // Switch to textureless bling phong rendering
+  const int propMaterial = 1; // bullets and bunnies
   activeProg = programs[3];
-  activeMaterial = materials[1];
-  activeProg->bind();
-
-  GLint uLP = activeProg->getUniform("lightsPos");
-  GLint uLC = activeProg->getUniform("lightsColor");
-  GLint uP = activeProg->getUniform("P");
-  GLint uM = activeProg->getUniform("MV");
-
-  // upload the same P and MV you used for your scene objects
-  glUniformMatrix4fv(uP, 1, GL_FALSE, glm::value_ptr(P->topMatrix()));
-  glUniformMatrix4fv(uM, 1, GL_FALSE, glm::value_ptr(MV->topMatrix()));
-
-  // assume viewLightPositions & lightColors are std::vector<glm::vec3> of size
-  glUniform3fv(uLP, lights.size(), glm::value_ptr(viewLightPositions[0]));
-  glUniform3fv(uLC, lights.size(), glm::value_ptr(lightColors[0]));
-  glUniform3f(activeProg->getUniform("ke"), activeMaterial->getMaterialKE().x,
-              activeMaterial->getMaterialKE().y,
-              activeMaterial->getMaterialKE().z);
-  glUniform3f(activeProg->getUniform("kd"), activeMaterial->getMaterialKD().x,
-              activeMaterial->getMaterialKD().y,
-              activeMaterial->getMaterialKD().z);
-  glUniform3f(activeProg->getUniform("ks"), activeMaterial->getMaterialKS().x,
-              activeMaterial->getMaterialKS().y,
-              activeMaterial->getMaterialKS().z);
-  glUniform1f(activeProg->getUniform("s"), activeMaterial->getMaterialS());
-  drawBullets(activeProg, P, MV, deltaTime, bulletManager, structures);
-
-  activeProg->unbind();
-
-  activeProg = programs[5];
-  activeMaterial = materials[1];
-  activeProg->bind();
-  glUniformMatrix4fv(activeProg->getUniform("P"), 1, GL_FALSE,
-                     glm::value_ptr(P->topMatrix()));
-  glUniformMatrix4fv(activeProg->getUniform("MV"), 1, GL_FALSE,
-                     glm::value_ptr(MV->topMatrix()));
-  glUniform3f(activeProg->getUniform("ke"), activeMaterial->getMaterialKE().x,
-              activeMaterial->getMaterialKE().y,
-              activeMaterial->getMaterialKE().z);
-  glUniform3f(activeProg->getUniform("kd"), activeMaterial->getMaterialKD().x,
-              activeMaterial->getMaterialKD().y,
-              activeMaterial->getMaterialKD().z);
-  glUniform3f(activeProg->getUniform("ks"), activeMaterial->getMaterialKS().x,
-              activeMaterial->getMaterialKS().y,
-              activeMaterial->getMaterialKS().z);
-  glUniform1f(activeProg->getUniform("s"), activeMaterial->getMaterialS());
-  glUniform3fv(activeProg->getUniform("lightsPos"), lights.size(),
-               glm::value_ptr(viewLightPositions[0]));
-  glUniform3fv(activeProg->getUniform("lightsColor"), lights.size(),
-               glm::value_ptr(lightColors[0]));
-  drawBunnies(activeProg, P, MV, lights, viewLightPositions, lightColors,
-              activeMaterial, materials, bunnies, width, height);
-  activeProg->unbind();
+  activeMaterial = materials[propMaterial];
+  queueBullets(renderQueue, activeProg, drawUniforms[3], propMaterial,
+               bulletManager, frustum);
+
+  queueTargets(renderQueue, activeProg, drawUniforms[3], propMaterial,
+               *targets, frustum);
+
+  renderQueue.submit(RenderPass::OVERLAY, nullptr, 0, 0, 0,
+                     [width, height]() { drawReticle(width, height); });
+
+  renderQueue.flush();
 
   MV->popMatrix();
   P->popMatrix();
 
-  drawReticle(width, height);
+  dynamicRing.endFrame();
+  frameStats.endFrame();
 
   GLSL::checkError(GET_FILE_LINE);
 }
 
 int main(int argc, char **argv) {
   if (argc < 2) {
-    cout << "Usage: TargetPractice RESOURCE_DIR" << endl;
+    cout << "Usage: TargetPractice RESOURCE_DIR [--no-shader-cache]"
+         << " [--no-mesh-cache] [--no-quantize] [--mesh] [--targets N]"
+         << endl;
     return 0;
   }
   RESOURCE_DIR = argv[1] + string("/");
+  // Linked shader binaries are kept in ./shader_cache, startup prints how
+  // long building the shaders took with or without it. Compiled meshes go
+  // in ./mesh_cache the same way.
+  bool shaderCache = true;
+  bool meshCache = true;
+  for (int i = 2; i < argc; ++i) {
+    if (string(argv[i]) == "--no-shader-cache")
+      shaderCache = false;
+    if (string(argv[i]) == "--no-mesh-cache")
+      meshCache = false;
+    if (string(argv[i]) == "--no-quantize")
+      Shape::setQuantize(false); // full float vertices, for comparison
+    if (string(argv[i]) == "--mesh")
+      keyToggles[(unsigned)'g'] = true; // start as if 'g' was pressed
+    if (string(argv[i]) == "--targets" && i + 1 < argc)
+      extraTargets = atoi(argv[++i]);
+  }
+  Program::setBinaryCacheDir(shaderCache ? "shader_cache" : "");
+  Shape::setMeshCacheDir(meshCache ? "mesh_cache" : "");
 
   // Set error callback.
   glfwSetErrorCallback(error_callback);
@@ -543,7 +573,14 @@ int main(int argc, char **argv) {
     // Poll for and process events.
     glfwPollEvents();
   }
-  // Quit program.
+  // Quit program. GL objects owned by globals go first, while the context
+  // is still current; the globals themselves are destroyed after main.
+  staticBatcher.release();
+  structures.clear();
+  rubble.release();
+  uniformBlocks.release();
+  vaoCache.release();
+  dynamicRing.release();
   glfwDestroyWindow(window);
   glfwTerminate();
   return 0;